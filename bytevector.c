@@ -1,14 +1,21 @@
+#include <fcntl.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "lisp.h"
 
 #define LENGTH(x) ST_BYTEVECTOR_LENGTH(x)
 #define DATA(x) ST_BYTEVECTOR_DATA(x)
+#define READ_ONLY(x) ST_BYTEVECTOR(x)->read_only
 
 StObject St_MakeBytevector(int size, int byte)
 {
     StObject o = St_Alloc2(TBYTEVECTOR, sizeof(struct StBytevectorRec) + size);
     LENGTH(o) = size;
+    DATA(o) = ST_BYTEVECTOR(o)->storage;
+    READ_ONLY(o) = false;
     if (byte >= 0)
     {
         memset(DATA(o), byte, size);
@@ -27,6 +34,55 @@ StObject St_MakeBytevectorFromList(StObject bytes)
     return o;
 }
 
+static void Unmap(GC_PTR obj, GC_PTR client_data __attribute__((unused)))
+{
+    munmap(DATA(ST_OBJECT(obj)), LENGTH(ST_OBJECT(obj)));
+}
+
+// Maps a regular file into a read-only bytevector; the mapping is
+// released when the bytevector is collected.
+StObject St_MakeBytevectorFromFile(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        St_Error("file->bytevector: open failed");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        St_Error("file->bytevector: regular file required");
+    }
+
+    // an empty file can't be mapped
+    if (st.st_size == 0)
+    {
+        close(fd);
+        StObject o = St_MakeBytevector(0, -1);
+        READ_ONLY(o) = true;
+        return o;
+    }
+
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED)
+    {
+        St_Error("file->bytevector: mmap failed");
+    }
+
+    StObject o = St_Alloc2(TBYTEVECTOR, sizeof(struct StBytevectorRec));
+    LENGTH(o) = st.st_size;
+    DATA(o) = p;
+    READ_ONLY(o) = true;
+
+    GC_register_finalizer(o, Unmap, NULL, NULL, NULL);
+
+    return o;
+}
+
 size_t St_BytevectorLength(StObject b)
 {
     return LENGTH(b);
@@ -48,6 +104,13 @@ size_t St_BytevectorLength(StObject b)
         }                                                               \
     } while (0)
 
+#define VALIDATE_WRITABLE(n, b)                                         \
+    do {                                                                \
+        if (READ_ONLY(b))                                               \
+        {                                                               \
+            St_Error("%s: bytevector is read-only", (n));               \
+        }                                                               \
+    } while (0)
 
 uint8_t St_BytevectorU8Ref(StObject b, int k)
 {
@@ -59,6 +122,7 @@ uint8_t St_BytevectorU8Ref(StObject b, int k)
 void St_BytevectorU8Set(StObject b, int k, uint8_t byte)
 {
     VALIDATE_INDEX("bytevector-u8-set!", b, k);
+    VALIDATE_WRITABLE("bytevector-u8-set!", b);
 
     DATA(b)[k] = byte;
 }
@@ -92,6 +156,7 @@ StObject St_MakeBytevectorFrom(StObject b, int start, int end)
 void St_BytevectorCopy(StObject to, int at, StObject from, int start, int end)
 {
     VALIDATE_INDEX("bytevector-copy!", to, at);
+    VALIDATE_WRITABLE("bytevector-copy!", to);
 
     if (start < 0)
     {
@@ -22,6 +22,7 @@ static StObject primitiveSyntaxes()
         "or",
         "and",
         "define-macro",
+        "define-syntax",
         NULL,
     };
 
@@ -48,9 +49,122 @@ typedef struct
     StObject env;
     StObject sets;
     bool toplevel;
-    int stackoffset;
+    StObject lets;     // alist of (symbol . index) for variables bound on the stack
+    int depth;         // number of words pushed above the current frame
+    StObject inlining; // procedures being inlined at this point
+    StObject defining; // (symbol . lambda) of the toplevel procedure being defined
 } StCompileContext;
 
+// Scratch data of the compiler (environments, variable sets and rewritten
+// source) is allocated in the region, which St_Compile releases when it
+// returns. Emitted code and anything stored into the module must be
+// allocated on the GC heap with St_Cons.
+
+static StObject tcons(StObject car, StObject cdr)
+{
+    return St_RegionCons(car, cdr);
+}
+
+#define TLIST1(a0) tcons((a0), Nil)
+
+#define T_APPEND1(head, tail, value)                    \
+    do {                                                \
+        if (ST_NULLP(head))                             \
+        {                                               \
+            (head) = (tail) = tcons((value), Nil);      \
+        }                                               \
+        else                                            \
+        {                                               \
+            ST_CDR_SET(tail, tcons((value), Nil));      \
+            tail = ST_CDR(tail);                        \
+        }                                               \
+    } while (0)
+
+static StObject treverse(StObject list)
+{
+    StObject r = Nil;
+
+    ST_FOREACH(p, list) {
+        r = tcons(ST_CAR(p), r);
+    }
+    return r;
+}
+
+static StObject tappend(StObject l1, StObject l2)
+{
+    StObject h = Nil, t = Nil;
+
+    ST_FOREACH(p, l1) {
+        T_APPEND1(h, t, ST_CAR(p));
+    }
+
+    if (ST_NULLP(h))
+    {
+        return l2;
+    }
+
+    ST_CDR_SET(t, l2);
+    return h;
+}
+
+static StObject set_cons(StObject obj, StObject s)
+{
+    return St_SetMemberP(obj, s)
+        ? s
+        : tcons(obj, s);
+}
+
+static StObject set_union(StObject s1, StObject s2)
+{
+    ST_FOREACH(p, s1) {
+        s2 = set_cons(ST_CAR(p), s2);
+    }
+    return s2;
+}
+
+// keeps the order of elements
+static StObject set_append(StObject s1, StObject s2)
+{
+    StObject h = Nil, t = Nil;
+
+    ST_FOREACH(p, s1) {
+        T_APPEND1(h, t, ST_CAR(p));
+    }
+    ST_FOREACH(p, s2) {
+        if (!St_SetMemberP(ST_CAR(p), h))
+        {
+            T_APPEND1(h, t, ST_CAR(p));
+        }
+    }
+    return h;
+}
+
+static StObject set_minus(StObject s1, StObject s2)
+{
+    StObject h = Nil, t = Nil;
+
+    ST_FOREACH(p, s1) {
+        if (!St_SetMemberP(ST_CAR(p), s2))
+        {
+            T_APPEND1(h, t, ST_CAR(p));
+        }
+    }
+    return h;
+}
+
+static StObject set_intersect(StObject s1, StObject s2)
+{
+    StObject h = Nil, t = Nil;
+
+    ST_FOREACH(p, s1) {
+        if (St_SetMemberP(ST_CAR(p), s2))
+        {
+            T_APPEND1(h, t, ST_CAR(p));
+        }
+    }
+    return h;
+}
+
 
 static StObject compile(StCompileContext *ctx, StObject expr, StObject next);
 
@@ -70,12 +184,19 @@ static StObject compile_lookup(StCompileContext *ctx, StObject x, StObject next,
     strcpy(buf, insn);
     char *bp = buf + strlen(insn);
 
+    StObject let = St_Assq(x, ctx->lets);
+    if (ST_TRUTHYP(let))
+    {
+        strcpy(bp, "-local");
+        return ST_LIST3(I(buf), ST_CDR(let), next);
+    }
+
     int nl = 0;
     ST_FOREACH(locals, ST_CAR(ctx->env)) {
         if (ST_CAR(locals) == x)
         {
             strcpy(bp, "-local");
-            return ST_LIST3(I(buf), St_Integer(nl - ctx->stackoffset), next);
+            return ST_LIST3(I(buf), St_Integer(nl), next);
         }
         nl++;
     }
@@ -95,8 +216,34 @@ static StObject compile_lookup(StCompileContext *ctx, StObject x, StObject next,
     return ST_LIST3(I(buf), St_Integer(nm), next);
 }
 
+static bool lexically_boundP(StCompileContext *ctx, StObject x)
+{
+    return ST_TRUTHYP(St_Assq(x, ctx->lets))
+        || St_SetMemberP(x, ST_CAR(ctx->env))
+        || St_SetMemberP(x, ST_CDR(ctx->env));
+}
+
+// A module binding that has been defined and never reassigned is embedded
+// as a constant. The module rewrites the instruction back to refer-module
+// when the binding is reassigned later.
 static StObject compile_refer(StCompileContext *ctx, StObject x, StObject next)
 {
+    if (!lexically_boundP(ctx, x))
+    {
+        int nm = module_add(ctx->module, x);
+
+        if (St_ModuleConstantP(ctx->module, nm))
+        {
+            StObject value = ST_CDR(St_ModuleRef(ctx->module, nm));
+            StObject insn = ST_LIST3(I("constant"), value, next);
+            StObject deopt = ST_LIST3(I("refer-module"), St_Integer(nm), next);
+
+            St_ModuleAddDependent(ctx->module, nm, insn, deopt);
+
+            return insn;
+        }
+    }
+
     return compile_lookup(ctx, x, next, "refer");
 }
 
@@ -129,29 +276,29 @@ static StObject find_define_sub(StObject body)
                 {
                     St_Error("define: multiple define: %s", ST_SYMBOL_VALUE(sym));
                 }
-                defs = St_Cons(ST_CADR(x), defs);
+                defs = tcons(ST_CADR(x), defs);
             }
             else if (ST_CAR(x) == I("begin"))
             {
                 StObject r = find_define_sub(ST_CDR(x));
-                defs = St_SetUnion(ST_CAR(r), defs);
+                defs = set_union(ST_CAR(r), defs);
                 if (ST_CDR(r) == True)
                 {
-                    return St_Cons(defs, True);
+                    return tcons(defs, True);
                 }
             }
             else
             {
-                return St_Cons(defs, True);
+                return tcons(defs, True);
             }
         }
     }
-    return St_Cons(defs, False);
+    return tcons(defs, False);
 }
 
 static StObject find_define(StObject body)
 {
-    return St_Reverse(ST_CAR(find_define_sub(body)));
+    return treverse(ST_CAR(find_define_sub(body)));
 }
 
 static StObject find_free(StObject x, StObject b)
@@ -160,7 +307,7 @@ static StObject find_free(StObject x, StObject b)
     {
         return (St_SetMemberP(x, b))
             ? Nil
-            : ST_LIST1(x);
+            : TLIST1(x);
     }
 
     if (ST_PAIRP(x))
@@ -173,23 +320,27 @@ static StObject find_free(StObject x, StObject b)
             return Nil;
         }
 
+        CASE(define-syntax) {
+            return Nil;
+        }
+
         CASE(lambda) {
             StObject vars = ST_CADR(x);
             StObject body = ST_CDDR(x);
 
             if (ST_SYMBOLP(vars))
             {
-                b = St_SetCons(vars, b);
+                b = set_cons(vars, b);
             }
             if (ST_PAIRP(vars))
             {
                 StObject p;
                 for (p = vars; ST_PAIRP(p); p = ST_CDR(p)) {
-                    b = St_SetCons(ST_CAR(p), b);
+                    b = set_cons(ST_CAR(p), b);
                 }
                 if (!ST_NULLP(p))
                 {
-                    b = St_SetCons(p, b);
+                    b = set_cons(p, b);
                 }
             }
             return find_free(body, b);
@@ -205,8 +356,8 @@ static StObject find_free(StObject x, StObject b)
             StObject thenc = ST_CADDR(x);
             StObject elsec = ST_CDR(ST_CDDR(x));
 
-            return St_SetUnion(find_free(testc, b),
-                               St_SetUnion(find_free(thenc, b),
+            return set_union(find_free(testc, b),
+                               set_union(find_free(thenc, b),
                                            find_free(elsec, b)));
         }
 
@@ -220,7 +371,7 @@ static StObject find_free(StObject x, StObject b)
             StObject var = ST_CADR(x);
             StObject exp = ST_CADDR(x);
 
-            return St_SetUnion(St_SetMemberP(var, b) ? Nil : ST_LIST1(var),
+            return set_union(St_SetMemberP(var, b) ? Nil : TLIST1(var),
                                find_free(exp, b));
         }
 
@@ -230,11 +381,17 @@ static StObject find_free(StObject x, StObject b)
             return find_free(exp, b);
         }
 
+        CASE(call/ec) {
+            StObject exp = ST_CADR(x);
+
+            return find_free(exp, b);
+        }
+
         else {
             StObject r = Nil;
 
             ST_FOREACH(p, x) {
-                r = St_SetUnion(find_free(ST_CAR(p), b), r);
+                r = set_union(find_free(ST_CAR(p), b), r);
             }
 
             return r;
@@ -269,7 +426,7 @@ static StObject find_sets(StObject x, StObject v)
             StObject vars = ST_CADR(x);
             StObject body = ST_CDDR(x);
 
-            return find_sets(body, St_SetMinus(v, vars));
+            return find_sets(body, set_minus(v, vars));
         }
 
         CASE(if) {
@@ -277,8 +434,8 @@ static StObject find_sets(StObject x, StObject v)
             StObject thenc = ST_CADDR(x);
             StObject elsec = ST_CDR(ST_CDDR(x));
 
-            return St_SetUnion(find_sets(testc, v),
-                               St_SetUnion(find_sets(thenc, v),
+            return set_union(find_sets(testc, v),
+                               set_union(find_sets(thenc, v),
                                            find_sets(elsec, v)));
         }
 
@@ -286,7 +443,7 @@ static StObject find_sets(StObject x, StObject v)
             StObject var = ST_CADR(x);
             StObject x2 = ST_CADDR(x);
 
-            return St_SetUnion(St_SetMemberP(var, v) ? ST_LIST1(var) : Nil,
+            return set_union(St_SetMemberP(var, v) ? TLIST1(var) : Nil,
                                find_sets(x2, v));
         }
 
@@ -296,11 +453,17 @@ static StObject find_sets(StObject x, StObject v)
             return find_sets(exp, v);
         }
 
+        CASE(call/ec) {
+            StObject exp = ST_CADR(x);
+
+            return find_sets(exp, v);
+        }
+
         else {
             StObject r = Nil;
 
             ST_FOREACH(p, x) {
-                r = St_SetUnion(find_sets(ST_CAR(p), v), r);
+                r = set_union(find_sets(ST_CAR(p), v), r);
             }
 
             return r;
@@ -332,6 +495,38 @@ static int macro_arity(StObject m)
     return ST_LAMBDA_ARITY(ST_MACRO_PROC(m));
 }
 
+static StObject expand_macro(StObject o, StObject x)
+{
+    if (St_SyntaxRulesP(ST_MACRO_PROC(o)))
+    {
+        return St_SyntaxRulesExpand(ST_MACRO_PROC(o), x);
+    }
+
+    int arity = macro_arity(o);
+    int len = St_Length(x) - 1;
+
+    if (arity >= 0)
+    {
+        if (arity != len)
+        {
+            St_Error("%s: wrong number of arguments: required %d but got %d", ST_SYMBOL_VALUE(ST_MACRO_SYMBOL(o)), arity, len);
+        }
+    }
+    else
+    {
+        int required = -arity - 1;
+        if (required > len)
+        {
+            St_Error("%s: wrong number of arguments: required %d but got %d", ST_SYMBOL_VALUE(ST_MACRO_SYMBOL(o)), required, len);
+        }
+    }
+
+    StObject v = St_MakeVectorFromList(ST_CDR(x));
+    return St_SingleValue(St_Apply(ST_MACRO_PROC(o), &(StCallInfo){ ST_VECTOR(v), St_VectorLength(v), St_VectorLength(v) }));
+}
+
+static StObject expand(StObject m, StObject x);
+
 static StObject macroexpand(StObject m, StObject x)
 {
     if (ST_PAIRP(x))
@@ -344,33 +539,16 @@ static StObject macroexpand(StObject m, StObject x)
             return x;
         }
 
+        CASE(define-syntax) {
+            return x;
+        }
+
         if (ST_SYMBOLP(car))
         {
             StObject o = St_ModuleFind(m, car);
             if (ST_MACROP(o))
             {
-                int arity = macro_arity(o);
-                int len = St_Length(x) - 1;
-
-                if (arity >= 0)
-                {
-                    if (arity != len)
-                    {
-                        St_Error("%s: wrong number of arguments: required %d but got %d", ST_SYMBOL_VALUE(ST_MACRO_SYMBOL(o)), arity, len);
-                    }
-                }
-                else
-                {
-                    int required = -arity - 1;
-                    if (required > len)
-                    {
-                        St_Error("%s: wrong number of arguments: required %d but got %d", ST_SYMBOL_VALUE(ST_MACRO_SYMBOL(o)), required, len);
-                    }
-                }
-
-                StObject v = St_MakeVectorFromList(ST_CDR(x));
-                StObject nx = St_Apply(ST_MACRO_PROC(o), &(StCallInfo){ ST_VECTOR(v), St_VectorLength(v), St_VectorLength(v) });
-                return macroexpand(m, nx);
+                return macroexpand(m, expand_macro(o, x));
             }
         }
 
@@ -396,34 +574,90 @@ static StObject macroexpand(StObject m, StObject x)
     return x;
 }
 
-static StObject syntaxexpand(StObject m, StObject x)
+// Expands each element of xs. The list is copied only from the first
+// element that changed; an unchanged list is returned as is.
+static StObject expand_list(StObject m, StObject xs)
 {
-    if (ST_PAIRP(x))
+    StObject p, h = Nil, t = Nil;
+    bool changed = false;
+
+    for (p = xs; ST_PAIRP(p); p = ST_CDR(p)) {
+        StObject nx = expand(m, ST_CAR(p));
+
+        if (!changed && nx != ST_CAR(p))
+        {
+            for (StObject q = xs; q != p; q = ST_CDR(q)) {
+                ST_APPEND1(h, t, ST_CAR(q));
+            }
+            changed = true;
+        }
+
+        if (changed)
+        {
+            ST_APPEND1(h, t, nx);
+        }
+    }
+
+    if (!changed)
+    {
+        return xs;
+    }
+
+    ST_CDR_SET(t, p);
+    return h;
+}
+
+// Expands macros and syntaxes in a single walk. A syntax function rewrites
+// only its own form; the result is walked again here. A syntax returning
+// the form itself (e.g. define with a symbol) is treated as a core form.
+static StObject expand(StObject m, StObject x)
+{
+    while (ST_PAIRP(x))
     {
-        if (ST_SYMBOLP(ST_CAR(x)))
+        StObject car = ST_CAR(x);
+
+        if (car == I("quote") || car == I("define-syntax"))
         {
-            StObject o = St_ModuleFind(m, ST_CAR(x));
+            return x;
+        }
 
-            if (ST_SYNTAXP(o))
+        if (car == I("lambda"))
+        {
+            if (!ST_PAIRP(ST_CDR(x)))
             {
-                return ST_SYNTAX_BODY(o)(m, x);
+                return x;
             }
-        }
 
-        StObject p, h = Nil, t = Nil;
+            StObject body = expand_list(m, ST_CDDR(x));
 
-        for (p = x; ST_PAIRP(p); p = ST_CDR(p)) {
-            StObject nx = syntaxexpand(m, ST_CAR(p));
-            ST_APPEND1(h, t, nx);
+            return body == ST_CDDR(x)
+                ? x
+                : St_Cons(car, St_Cons(ST_CADR(x), body));
         }
 
-        if (!ST_NULLP(p))
+        if (ST_SYMBOLP(car))
         {
-            StObject nx = syntaxexpand(m, p);
-            ST_CDR_SET(t, nx);
+            StObject o = St_ModuleFind(m, car);
+
+            if (ST_MACROP(o))
+            {
+                x = expand_macro(o, x);
+                continue;
+            }
+
+            if (ST_SYNTAXP(o))
+            {
+                StObject nx = ST_SYNTAX_BODY(o)(m, x);
+
+                if (nx != x)
+                {
+                    x = nx;
+                    continue;
+                }
+            }
         }
 
-        return h;
+        return expand_list(m, x);
     }
 
     return x;
@@ -459,158 +693,1228 @@ static StObject compile_or(StCompileContext *ctx, StObject xs, StObject next)
     return compile(ctx, ST_CAR(xs), ST_LIST3(I("test"), next, compile_or(ctx, ST_CDR(xs), next)));
 }
 
-static StObject compile(StCompileContext *ctx, StObject x, StObject next)
+static StObject make_let_boxes(StObject sets, StObject lets, StObject next)
 {
-    if (ST_SYMBOLP(x))
-    {
-        return compile_refer(ctx, x, St_SetMemberP(x, ctx->sets) ? ST_LIST2(I("indirect"), next) : next);
+    ST_FOREACH(p, lets) {
+        if (St_SetMemberP(ST_CAAR(p), sets))
+        {
+            next = ST_LIST3(I("box"), ST_CDAR(p), next);
+        }
     }
+    return next;
+}
 
-    if (ST_PAIRP(x))
-    {
-        StObject car = ST_CAR(x);
+// Compiles body with vars bound to the values pushed above ctx->depth.
+static StObject compile_let_body(StCompileContext *ctx, StObject vars, StObject body, StObject next)
+{
+    int n = St_Length(vars);
+    StObject lets = ctx->lets;
+    StObject newlets = Nil;
 
-        if (car == I("quote"))
-        {
-            StObject obj = ST_CADR(x);
+    int j = 0;
+    ST_FOREACH(p, vars) {
+        StObject b = tcons(ST_CAR(p), St_Integer(-(ctx->depth + j) - 1));
+        lets = tcons(b, lets);
+        newlets = tcons(b, newlets);
+        j++;
+    }
 
-            return ST_LIST3(I("constant"), obj, next);
-        }
+    StCompileContext nctx = *ctx;
+    nctx.lets = lets;
+    nctx.sets = set_union(find_sets(body, vars), set_minus(ctx->sets, vars));
+    nctx.toplevel = false;
+    nctx.depth = ctx->depth + n;
 
-        if (car == I("---let---") ||
-            car == I("---let*---"))
-        {
-            int len = St_Length(x);
-            if (len < 2)
-            {
-                St_Error("compile: malformed let");
-            }
+    StObject nnext = tailP(next)
+        ? ST_LIST2(I("return"), St_Integer(ST_INT_VALUE(ST_CADR(next)) + n))
+        : ST_LIST4(I("shift"), St_Integer(0), St_Integer(n), next);
 
-            // Design decision: Set refer-local's offset negative values to point variables made by let.
-            // Because f register keeps its value when executing let body and binding expressions.
-            //
-            // (let ((s1 x1) (s2 x2)) body)
-            // => (x1 (argument (x2 (argument (body (shift 0 2 next))))))
-            //
-            //  s2 <-    refer-local -2
-            //  s1 <- f  refer-local -1
-            //  a1 <-    refer-local 0
-            //  a2 <-    refer-local 1
-            //  a3 <-    refer-local 2
-            //  frame
-            //  ------
+    return make_let_boxes(nctx.sets, newlets, compile_body(&nctx, body, nnext));
+}
 
-            StObject bindings = ST_CADR(x);
-            StObject body = ST_CDDR(x);
+// Binds vars on the stack above the current frame instead of allocating a
+// closure. vars and exprs are given in the order they are pushed.
+//
+// (let ((s1 x1) (s2 x2)) body) at depth d
+// => (x1 (argument (x2 (argument (body (shift 0 2 next))))))
+//
+//  s2       refer-local -(d + 2)
+//  s1       refer-local -(d + 1)
+//  ...      d words pushed by the enclosing code
+//       <-  f
+//  a1       refer-local 0
+//  a2       refer-local 1
+//  frame
+//  ------
+//
+// In tail position the body returns directly, dropping the let variables
+// together with the arguments of the current frame.
+static StObject compile_let(StCompileContext *ctx, StObject vars, StObject exprs, StObject body, StObject next)
+{
+    StObject c = compile_let_body(ctx, vars, body, next);
+    int j = St_Length(vars);
 
-            StObject vars = Nil, vt = Nil;
-            StObject exprs = Nil;
+    ST_FOREACH(p, treverse(exprs)) {
+        StCompileContext ectx = *ctx;
+        ectx.depth = ctx->depth + --j;
+        c = compile(&ectx, ST_CAR(p), ST_LIST2(I("argument"), c));
+    }
 
-            ST_FOREACH(p, bindings) {
-                ST_BIND2("let binding", ST_CAR(p), s, exp);
+    return c;
+}
 
-                if (!ST_SYMBOLP(s))
-                {
-                    St_Error("let bining: symbol reuqired");
-                }
+// ((lambda (p1 p2 ...) body) a1 a2 ...) is compiled as a let on the stack
+// when the lambda takes a fixed number of arguments and has no internal
+// definitions. Arguments are evaluated from the last one as an ordinary
+// call does. Returns False if the form is not applicable.
+static StObject compile_direct_application(StCompileContext *ctx, StObject lambda, StObject args, StObject next)
+{
+    StObject params = ST_CADR(lambda);
+    StObject body = ST_CDDR(lambda);
 
-                if (St_SetMemberP(s, vars))
-                {
-                    St_Error("let binding: multiple symbol: %s", ST_SYMBOL_VALUE(s));
-                }
+    if (!St_ListP(params) || St_Length(params) != St_Length(args) || !ST_NULLP(find_define(body)))
+    {
+        return False;
+    }
 
-                ST_APPEND1(vars, vt, s);
-                exprs = St_Cons(exp, exprs);
-            }
+    ST_FOREACH(p, params) {
+        if (!ST_SYMBOLP(ST_CAR(p)) || St_SetMemberP(ST_CAR(p), ST_CDR(p)))
+        {
+            return False;
+        }
+    }
 
-            StCompileContext nctx = *ctx;
-            nctx.env = St_Cons(St_SetAppend(vars, ST_CAR(ctx->env)), ST_CDR(ctx->env));
-            nctx.sets = find_sets(body, vars);
-            nctx.stackoffset = St_Length(vars);
-            StObject nnext = ST_LIST4(I("shift"), St_Integer(0), St_Integer(St_Length(vars)), next);
-            StObject c = make_boxes(nctx.sets, vars, compile_body(&nctx, body, nnext), 0);
+    return compile_let(ctx, treverse(params), treverse(args), body, next);
+}
 
-            ST_FOREACH(p, exprs) {
-                c = compile(ctx, ST_CAR(p), ST_LIST2(I("argument"), c));
-            }
+#define CASE_TABLE_LIMIT 1024
 
-            return c;
-        }
+// (---case--- key ('(datum ...) body ...) ... [(#t body ...)])
+//
+// Compiled to (switch-table min table else) when every datum is a fixnum
+// and they are dense enough, otherwise to (switch-hash table else). Both
+// jump to the body of the first clause containing the key.
+static StObject compile_case(StCompileContext *ctx, StObject key, StObject clauses, StObject next)
+{
+    StObject elsec = ST_LIST3(I("constant"), Nil, next);
+    StObject entries = Nil; // alist of (datum . code)
+    bool fixnums = true;
+    intptr_t min = 0, max = 0;
+    int count = 0;
 
-        if (car == I("lambda"))
+    ST_FOREACH(p, clauses) {
+        StObject clause = ST_CAR(p);
+        StObject body = compile_body(ctx, ST_CDR(clause), next);
+
+        if (ST_CAR(clause) == True)
         {
-            StObject params = ST_CADR(x);
-            StObject body = ST_CDDR(x);
-            StObject known_vars = St_SetUnion(primitiveSyntaxes(), St_ModuleSymbols(ctx->module));
+            elsec = body;
+            break;
+        }
 
-            StObject p;
-            int arity = 0;
-            StObject vars = Nil;
-            StObject tail = Nil;
+        ST_FOREACH(q, ST_CADR(ST_CAR(clause))) {
+            StObject d = ST_CAR(q);
 
-            for (p = params; ST_PAIRP(p); p = ST_CDR(p))
+            if (ST_TRUTHYP(St_Assv(d, entries)))
             {
-                arity++;
-                ST_APPEND1(vars, tail, ST_CAR(p));
+                continue;
             }
 
-            if (!ST_NULLP(p))
+            if (ST_INTP(d))
             {
-                arity = -arity - 1;
-                ST_APPEND1(vars, tail, p);
+                intptr_t v = ST_INT_VALUE(d);
+                min = count == 0 || v < min ? v : min;
+                max = count == 0 || v > max ? v : max;
             }
-
-            StObject defs = find_define(body);
-            StObject extended_vars = St_SetAppend(defs, vars);
-            StObject free = find_free(body, St_SetUnion(extended_vars, known_vars));
-
-            // Top-level defined functions must have no free variables because
-            // free variables point to stack allocated variable.
-            // Otherwise lambdas capture module functions.
-            if (ctx->toplevel)
+            else
             {
-                ST_FOREACH(p, free) {
-                    module_add(ctx->module, ST_CAR(p));
-                }
-                free = Nil;
+                fixnums = false;
             }
 
-            StObject sets = find_sets(body, vars);
-
-            int len_vars = St_Length(extended_vars);
+            entries = tcons(tcons(d, body), entries);
+            count++;
+        }
+    }
 
-            StCompileContext nctx = *ctx;
+    StObject insn;
 
-            nctx.env = St_Cons(extended_vars, free);
-            nctx.sets = St_SetUnion(sets,
-                                    St_SetUnion(defs,
-                                                St_SetIntersect(ctx->sets, free)));
-            nctx.toplevel = false;
-            nctx.stackoffset = 0;
+    if (fixnums && count > 0 && max - min < CASE_TABLE_LIMIT && max - min < 2 * count + 8)
+    {
+        StObject table = St_MakeVectorWithInitValue(max - min + 1, False);
 
-            StObject body_c = compile_body(&nctx, body, ST_LIST2(I("return"), St_Integer(len_vars)));
+        ST_FOREACH(p, entries) {
+            St_VectorSet(table, ST_INT_VALUE(ST_CAAR(p)) - min, ST_CDAR(p));
+        }
 
-            if (abs(arity) != len_vars)
-            {
-                int to_extend = len_vars - abs(arity);
-                body_c = ST_LIST3(I("extend"), St_Integer(to_extend), body_c);
-            }
+        insn = ST_LIST4(I("switch-table"), St_Integer(min), table, elsec);
+    }
+    else
+    {
+        StObject table = St_MakeHashtable(count * 2);
 
-            return collect_free(ctx, free,
-                                ST_LIST5(I("close"),
-                                         St_Integer(arity),
-                                         St_Integer(St_Length(free)),
-                                         make_boxes(sets, vars, body_c, 0),
-                                         next));
+        ST_FOREACH(p, entries) {
+            St_HashtableSet(table, ST_CAAR(p), ST_CDAR(p));
         }
 
-        if (car == I("begin"))
-        {
-            return compile_body(ctx, ST_CDR(x), next);
-        }
+        insn = ST_LIST3(I("switch-hash"), table, elsec);
+    }
 
-        if (car == I("if"))
-        {
+    return compile(ctx, key, insn);
+}
+
+#define INLINE_SIZE_LIMIT 32
+#define INLINE_DEPTH_LIMIT 4
+
+static int expr_size(StObject x)
+{
+    if (!ST_PAIRP(x))
+    {
+        return 1;
+    }
+
+    if (ST_CAR(x) == I("quote"))
+    {
+        return 1;
+    }
+
+    int size = 0;
+    for (; ST_PAIRP(x); x = ST_CDR(x)) {
+        size += expr_size(ST_CAR(x));
+    }
+    return size;
+}
+
+static bool expr_refersP(StObject x, StObject sym)
+{
+    if (x == sym)
+    {
+        return true;
+    }
+
+    if (!ST_PAIRP(x) || ST_CAR(x) == I("quote"))
+    {
+        return false;
+    }
+
+    for (; ST_PAIRP(x); x = ST_CDR(x)) {
+        if (expr_refersP(ST_CAR(x), sym))
+        {
+            return true;
+        }
+    }
+    return ST_SYMBOLP(x) && x == sym;
+}
+
+// Remembers (define sym (lambda ...)) at toplevel as an inlining candidate
+// if the lambda is small, takes a fixed number of arguments, has no
+// internal definitions and does not call itself.
+//
+// info: (body-insn lambda-expr free-variables)
+static void record_inline_candidate(StCompileContext *ctx, StObject sym, StObject lambda, StObject code)
+{
+    if (!ST_PAIRP(lambda) || ST_CAR(lambda) != I("lambda") || ST_CAR(code) != I("close"))
+    {
+        return;
+    }
+
+    StObject params = ST_CADR(lambda);
+    StObject body = ST_CDDR(lambda);
+
+    if (!St_ListP(params) ||
+        ST_NULLP(body) ||
+        !ST_NULLP(find_define(body)) ||
+        expr_size(body) > INLINE_SIZE_LIMIT ||
+        expr_refersP(body, sym))
+    {
+        return;
+    }
+
+    StObject free = find_free(body, set_union(params, primitiveSyntaxes()));
+    int nm = module_add(ctx->module, sym);
+
+    // free is scratch data; the info keeps a copy on the heap
+    St_ModuleSetInfo(ctx->module, nm, ST_LIST3(ST_CADDDR(code), lambda, St_Reverse(free)));
+}
+
+// Returns the lambda expression to be substituted for the operator of
+// (sym args ...), or False.
+static StObject find_inline_lambda(StCompileContext *ctx, StObject sym, StObject args)
+{
+    if (!ST_SYMBOLP(sym) ||
+        lexically_boundP(ctx, sym) ||
+        St_SetMemberP(sym, ctx->inlining) ||
+        St_Length(ctx->inlining) >= INLINE_DEPTH_LIMIT)
+    {
+        return False;
+    }
+
+    int nm = module_add(ctx->module, sym);
+    StObject info = St_ModuleInfo(ctx->module, nm);
+    StObject value = ST_CDR(St_ModuleRef(ctx->module, nm));
+
+    if (ST_NULLP(info) ||
+        !St_ModuleConstantP(ctx->module, nm) ||
+        !ST_LAMBDAP(value) ||
+        ST_LAMBDA_BODY(value) != ST_CAR(info))
+    {
+        return False;
+    }
+
+    StObject lambda = ST_CADR(info);
+
+    if (St_Length(ST_CADR(lambda)) != St_Length(args))
+    {
+        return False;
+    }
+
+    // the body must see the same globals as at its definition
+    ST_FOREACH(p, ST_CADDR(info)) {
+        if (lexically_boundP(ctx, ST_CAR(p)))
+        {
+            return False;
+        }
+    }
+
+    return lambda;
+}
+
+// Returns the lambda called by (f args ...) if it is known at compile
+// time and takes exactly argc arguments, or False. A module binding is
+// known when it has never been reassigned; the call is rewritten into an
+// ordinary apply when that changes. The clause of a case-lambda is chosen
+// here by argc.
+static StObject known_callee(StCompileContext *ctx, StObject f, int argc)
+{
+    StObject proc;
+
+    if (ST_PAIRP(f) && ST_CAR(f) == I("quote"))
+    {
+        proc = ST_CADR(f);
+    }
+    else if (ST_SYMBOLP(f) && !lexically_boundP(ctx, f))
+    {
+        int nm = module_add(ctx->module, f);
+
+        if (ST_PAIRP(ctx->defining) && ST_CAR(ctx->defining) == f)
+        {
+            proc = ST_CDR(ctx->defining);
+        }
+        else if (St_ModuleConstantP(ctx->module, nm))
+        {
+            proc = ST_CDR(St_ModuleRef(ctx->module, nm));
+        }
+        else
+        {
+            return False;
+        }
+    }
+    else
+    {
+        return False;
+    }
+
+    if (ST_CASE_LAMBDAP(proc))
+    {
+        proc = St_CaseLambdaClause(proc, argc);
+    }
+
+    return ST_LAMBDAP(proc) && ST_LAMBDA_ARITY(proc) == argc ? proc : False;
+}
+
+// A toplevel (define f (lambda ...)) allocates the procedure at compile
+// time so that its body can call itself with call-known. Those calls are
+// registered while f is still unbound; the body can only run after the
+// definition has stored the procedure, and any later assignment
+// deoptimizes them.
+static StObject compile_define_lambda(StCompileContext *ctx, StObject var, StObject lambda, StObject next)
+{
+    int nm = module_add(ctx->module, var);
+    StObject proc = St_Alloc2(TLAMBDA, sizeof(struct StLambdaRec));
+    StObject p;
+    int arity = 0;
+
+    for (p = ST_CADR(lambda); ST_PAIRP(p); p = ST_CDR(p)) {
+        arity++;
+    }
+
+    ST_LAMBDA_BODY(proc) = Nil;
+    ST_LAMBDA_FREE(proc) = Nil;
+    ST_LAMBDA_ARITY(proc) = ST_NULLP(p) ? arity : -arity - 1;
+
+    StCompileContext nctx = *ctx;
+    if (ST_UNBOUNDP(ST_CDR(St_ModuleRef(ctx->module, nm))))
+    {
+        nctx.defining = tcons(var, proc);
+    }
+
+    // toplevel lambdas have no free variables: (close arity 0 body next)
+    StObject c = compile(&nctx, lambda, Nil);
+    ST_LAMBDA_BODY(proc) = ST_CADDDR(c);
+
+    record_inline_candidate(ctx, var, lambda, c);
+
+    return ST_LIST3(I("constant"), proc, compile_assign(ctx, var, next));
+}
+
+static StObject compile_call(StCompileContext *ctx, StObject x, StObject next)
+{
+    StObject f = ST_CAR(x);
+    StObject args = ST_CDR(x);
+    int argc = St_Length(args);
+
+    if (ST_PAIRP(f) && ST_CAR(f) == I("lambda"))
+    {
+        StObject c = compile_direct_application(ctx, f, args, next);
+        if (ST_TRUTHYP(c))
+        {
+            return c;
+        }
+    }
+
+    StObject lambda = find_inline_lambda(ctx, f, args);
+    if (ST_TRUTHYP(lambda))
+    {
+        StCompileContext ictx = *ctx;
+        ictx.inlining = tcons(f, ctx->inlining);
+
+        StObject c = compile_direct_application(&ictx, lambda, args, next);
+        if (ST_TRUTHYP(c) && c != next)
+        {
+            // The body is entered through an insn of its own, which is
+            // rewritten into the ordinary call when f is redefined. The
+            // insns of the body may depend on other bindings themselves.
+            StObject entry = ST_LIST2(I("inlined"), c);
+            StObject deopt = ST_LIST2(I("inlined"), compile_call(&ictx, x, next));
+            St_ModuleAddDependent(ctx->module, module_add(ctx->module, f), entry, deopt);
+            return entry;
+        }
+    }
+
+    bool tail = tailP(next);
+    int base = ctx->depth + (tail ? 0 : 4); // frame
+
+    StCompileContext nctx = *ctx;
+    nctx.depth = base + argc;
+
+    StObject c;
+    StObject proc = known_callee(ctx, f, argc);
+
+    if (ST_TRUTHYP(proc))
+    {
+        c = ST_LIST2(I("call-known"), proc);
+
+        if (ST_SYMBOLP(f))
+        {
+            int nm = module_add(ctx->module, f);
+            St_ModuleAddDependent(ctx->module, nm, c,
+                                  ST_LIST3(I("refer-module"), St_Integer(nm), ST_LIST1(I("apply"))));
+        }
+
+        if (tail)
+        {
+            c = ST_LIST4(I("shift"), St_Integer(argc), ST_CADR(next), c);
+        }
+    }
+    else
+    {
+        c = compile(&nctx, f, tail
+                    ? ST_LIST4(I("shift"), St_Integer(argc), ST_CADR(next), ST_LIST1(I("apply")))
+                    : ST_LIST1(I("apply")));
+    }
+
+    int i = 0;
+    ST_FOREACH(p, args) {
+        nctx.depth = base + argc - 1 - i++;
+        c = compile(&nctx, ST_CAR(p), ST_LIST2(I("argument"), c));
+    }
+
+    return tail ? c : ST_LIST3(I("frame"), next, c);
+}
+
+// (---call-with-values--- producer consumer)
+//
+// When the consumer is a lambda expression its parameters are bound on the
+// stack from the values left by the producer:
+//
+// => (producer-call (receive n rest? (body (shift 0 n next))))
+//
+// Otherwise the values are pushed as the arguments of the consumer:
+//
+// => (frame next (consumer (argument (frame (values-apply (apply)) (producer (apply))))))
+static StObject compile_call_with_values(StCompileContext *ctx, StObject producer, StObject consumer, StObject next)
+{
+    StObject call = TLIST1(producer);
+
+    if (ST_PAIRP(consumer) && ST_CAR(consumer) == I("lambda") && ST_NULLP(find_define(ST_CDDR(consumer))))
+    {
+        StObject vars = Nil, tail = Nil;
+        StObject p;
+        int n = 0;
+        bool valid = true;
+
+        for (p = ST_CADR(consumer); ST_PAIRP(p); p = ST_CDR(p)) {
+            T_APPEND1(vars, tail, ST_CAR(p));
+            n++;
+        }
+        if (!ST_NULLP(p))
+        {
+            T_APPEND1(vars, tail, p);
+        }
+
+        ST_FOREACH(q, vars) {
+            if (!ST_SYMBOLP(ST_CAR(q)) || St_SetMemberP(ST_CAR(q), ST_CDR(q)))
+            {
+                valid = false;
+            }
+        }
+
+        if (valid)
+        {
+            StObject c = compile_let_body(ctx, vars, ST_CDDR(consumer), next);
+            c = ST_LIST4(I("receive"), St_Integer(n), ST_NULLP(p) ? False : True, c);
+            return compile_call(ctx, call, c);
+        }
+    }
+
+    StCompileContext nctx = *ctx;
+    nctx.depth = ctx->depth + 4 + 1; // frame and consumer
+
+    StObject c = compile_call(&nctx, call, ST_LIST2(I("values-apply"), ST_LIST1(I("apply"))));
+    nctx.depth = ctx->depth + 4;
+    c = compile(&nctx, consumer, ST_LIST2(I("argument"), c));
+    return ST_LIST3(I("frame"), next, c);
+}
+
+// Lambda lifting
+//
+// An internal (define f (lambda params body ...)) whose f is only ever
+// called is compiled once into a lambda object without free variables.
+// The lexical variables it refers to are passed as extra arguments, so
+// (f args ...) becomes ('#<lambda> args ... vars ...) and calling f
+// allocates no closure.
+
+static StObject param_list(StObject params)
+{
+    StObject vars = Nil;
+    StObject tail = Nil;
+    StObject p;
+
+    for (p = params; ST_PAIRP(p); p = ST_CDR(p)) {
+        T_APPEND1(vars, tail, ST_CAR(p));
+    }
+    if (!ST_NULLP(p))
+    {
+        T_APPEND1(vars, tail, p);
+    }
+    return vars;
+}
+
+static bool operator_onlyP(StObject x, StObject sym);
+
+static bool operator_only_listP(StObject xs, StObject sym)
+{
+    for (; ST_PAIRP(xs); xs = ST_CDR(xs)) {
+        if (!operator_onlyP(ST_CAR(xs), sym))
+        {
+            return false;
+        }
+    }
+    return xs != sym;
+}
+
+// true if sym occurs in x only as the operator of calls
+static bool operator_onlyP(StObject x, StObject sym)
+{
+    if (x == sym)
+    {
+        return false;
+    }
+
+    if (!ST_PAIRP(x) || ST_CAR(x) == I("quote"))
+    {
+        return true;
+    }
+
+    if (ST_CAR(x) == I("lambda"))
+    {
+        return !expr_refersP(ST_CADR(x), sym) && operator_only_listP(ST_CDDR(x), sym);
+    }
+
+    return operator_only_listP(ST_CAR(x) == sym ? ST_CDR(x) : x, sym);
+}
+
+// returns names of lifted procedures called where one of their extra
+// arguments is shadowed by an inner lambda
+static StObject lift_shadowed(StObject x, StObject lifted, StObject bound)
+{
+    if (!ST_PAIRP(x) || ST_CAR(x) == I("quote"))
+    {
+        return Nil;
+    }
+
+    StObject r = Nil;
+
+    if (ST_CAR(x) == I("lambda"))
+    {
+        bound = set_union(param_list(ST_CADR(x)), bound);
+        x = ST_CDDR(x);
+    }
+    else
+    {
+        StObject l = St_Assq(ST_CAR(x), lifted);
+        if (ST_TRUTHYP(l) && !ST_NULLP(set_intersect(ST_CDDR(l), bound)))
+        {
+            r = TLIST1(ST_CAR(x));
+        }
+    }
+
+    for (; ST_PAIRP(x); x = ST_CDR(x)) {
+        r = set_union(lift_shadowed(ST_CAR(x), lifted, bound), r);
+    }
+    return r;
+}
+
+static StObject lift_rewrite(StObject x, StObject lifted);
+
+static StObject lift_rewrite_list(StObject xs, StObject lifted)
+{
+    StObject r = Nil;
+    StObject tail = Nil;
+
+    for (; ST_PAIRP(xs); xs = ST_CDR(xs)) {
+        T_APPEND1(r, tail, lift_rewrite(ST_CAR(xs), lifted));
+    }
+    if (!ST_NULLP(xs))
+    {
+        ST_CDR(tail) = xs;
+    }
+    return r;
+}
+
+// lifted: ((name lambda-object . extra-variables) ...)
+static StObject lift_rewrite(StObject x, StObject lifted)
+{
+    if (!ST_PAIRP(x) || ST_CAR(x) == I("quote"))
+    {
+        return x;
+    }
+
+    if (ST_CAR(x) == I("lambda"))
+    {
+        return tcons(ST_CAR(x), tcons(ST_CADR(x), lift_rewrite_list(ST_CDDR(x), lifted)));
+    }
+
+    StObject r = lift_rewrite_list(x, lifted);
+    StObject l = St_Assq(ST_CAR(x), lifted);
+
+    if (ST_FALSEP(l))
+    {
+        return r;
+    }
+
+    return tcons(tcons(I("quote"), TLIST1(ST_CADR(l))), tappend(ST_CDR(r), ST_CDDR(l)));
+}
+
+static StObject lexical_variables(StCompileContext *ctx)
+{
+    StObject vars = set_union(ST_CAR(ctx->env), ST_CDR(ctx->env));
+
+    ST_FOREACH(p, ctx->lets) {
+        vars = set_cons(ST_CAAR(p), vars);
+    }
+    return vars;
+}
+
+static StObject lift_candidates(StObject vars, StObject body)
+{
+    StObject cands = Nil;
+
+    ST_FOREACH(p, body) {
+        StObject x = ST_CAR(p);
+
+        if (!ST_PAIRP(x) || ST_CAR(x) != I("define") || St_Length(x) != 3)
+        {
+            continue;
+        }
+
+        StObject name = ST_CADR(x);
+        StObject lambda = ST_CADDR(x);
+
+        if (!ST_PAIRP(lambda) ||
+            ST_CAR(lambda) != I("lambda") ||
+            !St_ListP(ST_CADR(lambda)) ||
+            St_SetMemberP(name, vars))
+        {
+            continue;
+        }
+
+        bool only = true;
+        ST_FOREACH(q, body) {
+            if (!operator_onlyP(ST_CAR(q) == x ? lambda : ST_CAR(q), name))
+            {
+                only = false;
+                break;
+            }
+        }
+
+        if (only)
+        {
+            cands = tcons(tcons(name, lambda), cands);
+        }
+    }
+
+    return cands;
+}
+
+// Returns ((name lambda-expr . extra-variables) ...) for the candidates
+// which can be lifted.
+static StObject lift_analyze(StCompileContext *ctx, StObject vars, StObject body, StObject cands)
+{
+    StObject defs = find_define(body);
+    StObject visible = set_union(set_union(vars, defs), lexical_variables(ctx));
+    StObject assigned = set_union(find_sets(body, set_union(vars, defs)), ctx->sets);
+
+    while (!ST_NULLP(cands))
+    {
+        StObject names = Nil;
+        StObject lifted = Nil;
+
+        ST_FOREACH(p, cands) {
+            StObject name = ST_CAAR(p);
+            StObject lambda = ST_CDAR(p);
+            StObject free = set_intersect(find_free(lambda, Nil), visible);
+
+            names = tcons(name, names);
+            lifted = tcons(tcons(name, tcons(lambda, free)), lifted);
+        }
+
+        // a procedure passes its extra arguments on to the ones it calls
+        for (bool changed = true; changed;) {
+            changed = false;
+            ST_FOREACH(p, lifted) {
+                StObject extras = ST_CDDR(ST_CAR(p));
+                ST_FOREACH(q, extras) {
+                    StObject l = St_Assq(ST_CAR(q), lifted);
+                    if (ST_TRUTHYP(l))
+                    {
+                        StObject u = set_union(ST_CDDR(l), ST_CDDR(ST_CAR(p)));
+                        if (St_Length(u) != St_Length(ST_CDDR(ST_CAR(p))))
+                        {
+                            ST_CDR(ST_CDAR(p)) = u;
+                            changed = true;
+                        }
+                    }
+                }
+            }
+        }
+
+        // boxed variables can't be passed by value
+        StObject rejected = Nil;
+        ST_FOREACH(p, lifted) {
+            StObject extras = set_minus(ST_CDDR(ST_CAR(p)), names);
+            ST_CDR(ST_CDAR(p)) = extras;
+
+            ST_FOREACH(q, extras) {
+                if (St_SetMemberP(ST_CAR(q), assigned) || St_SetMemberP(ST_CAR(q), defs))
+                {
+                    rejected = set_cons(ST_CAAR(p), rejected);
+                }
+            }
+        }
+        rejected = set_union(lift_shadowed(body, lifted, Nil), rejected);
+
+        if (ST_NULLP(rejected))
+        {
+            return lifted;
+        }
+
+        StObject rest = Nil;
+        ST_FOREACH(p, cands) {
+            if (!St_SetMemberP(ST_CAAR(p), rejected))
+            {
+                rest = tcons(ST_CAR(p), rest);
+            }
+        }
+        cands = rest;
+    }
+
+    return Nil;
+}
+
+static StObject lift_local_procedures(StCompileContext *ctx, StObject vars, StObject body)
+{
+    StObject lifted = lift_analyze(ctx, vars, body, lift_candidates(vars, body));
+
+    if (ST_NULLP(lifted))
+    {
+        return body;
+    }
+
+    StObject exprs = Nil;
+    ST_FOREACH(p, lifted) {
+        StObject l = ST_CAR(p);
+        StObject lambda = ST_CADR(l);
+        StObject c = St_Alloc2(TLAMBDA, sizeof(struct StLambdaRec));
+
+        ST_LAMBDA_BODY(c) = Nil;
+        ST_LAMBDA_FREE(c) = Nil;
+        ST_LAMBDA_ARITY(c) = St_Length(ST_CADR(lambda)) + St_Length(ST_CDDR(l));
+
+        exprs = tcons(lambda, exprs);
+        ST_CAR(ST_CDR(l)) = c;
+    }
+    exprs = treverse(exprs);
+
+    ST_FOREACH(p, lifted) {
+        StObject l = ST_CAR(p);
+        StObject lambda = ST_CAR(exprs);
+        StObject src = tcons(I("lambda"),
+                               tcons(tappend(ST_CADR(lambda), ST_CDDR(l)),
+                                       lift_rewrite_list(ST_CDDR(lambda), lifted)));
+        StCompileContext lctx = { ctx->module, tcons(Nil, Nil), Nil, true, Nil, 0, ctx->inlining, ctx->defining };
+
+        ST_LAMBDA_BODY(ST_CADR(l)) = ST_CADDDR(compile(&lctx, src, Nil));
+        exprs = ST_CDR(exprs);
+    }
+
+    StObject r = Nil;
+    StObject tail = Nil;
+    ST_FOREACH(p, body) {
+        StObject x = ST_CAR(p);
+        if (ST_PAIRP(x) && ST_CAR(x) == I("define") && ST_TRUTHYP(St_Assq(ST_CADR(x), lifted)))
+        {
+            continue;
+        }
+        T_APPEND1(r, tail, lift_rewrite(x, lifted));
+    }
+    return r;
+}
+
+// Escape continuations
+//
+// (call/ec receiver) passes an escape procedure, which is valid only until
+// the call returns. Calling it drops the stack back to the frame of the
+// call in O(1) instead of copying the whole stack as call/cc does.
+//
+// (call/cc (lambda (k) body ...)) is compiled as call/ec when k can not be
+// called after the receiver returns: k is only called, either directly
+// from body or from internal procedures which are themselves only called.
+
+static bool escape_only_bodyP(StObject body, StObject ks);
+
+static bool escape_only_listP(StObject xs, StObject ks);
+
+// true if x refers to the escapes in ks only as operators of calls made
+// while x is running
+static bool escape_onlyP(StObject x, StObject ks)
+{
+    if (ST_SYMBOLP(x))
+    {
+        return !St_SetMemberP(x, ks);
+    }
+
+    if (!ST_PAIRP(x) || ST_CAR(x) == I("quote") || ST_CAR(x) == I("define-syntax"))
+    {
+        return true;
+    }
+
+    StObject car = ST_CAR(x);
+
+    if (car == I("lambda"))
+    {
+        // a closure may be called after the receiver returns
+        return ST_NULLP(set_intersect(find_free(x, Nil), ks));
+    }
+
+    if (ST_PAIRP(car) && ST_CAR(car) == I("lambda"))
+    {
+        return escape_only_listP(ST_CDR(x), ks)
+            && escape_only_bodyP(ST_CDDR(car), set_minus(ks, param_list(ST_CADR(car))));
+    }
+
+    return escape_only_listP(St_SetMemberP(car, ks) ? ST_CDR(x) : x, ks);
+}
+
+static bool escape_only_listP(StObject xs, StObject ks)
+{
+    for (; ST_PAIRP(xs); xs = ST_CDR(xs)) {
+        if (!escape_onlyP(ST_CAR(xs), ks))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool escape_only_bodyP(StObject body, StObject ks)
+{
+    StObject procs = lift_candidates(Nil, body);
+
+    // internal procedures calling an escape are escapes too
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        ST_FOREACH(p, procs) {
+            StObject name = ST_CAAR(p);
+            if (!St_SetMemberP(name, ks) && !ST_NULLP(set_intersect(find_free(ST_CDAR(p), Nil), ks)))
+            {
+                ks = set_cons(name, ks);
+                changed = true;
+            }
+        }
+    }
+
+    ST_FOREACH(p, body) {
+        StObject x = ST_CAR(p);
+
+        if (ST_PAIRP(x) && ST_CAR(x) == I("define") && St_Length(x) == 3)
+        {
+            StObject proc = St_Assq(ST_CADR(x), procs);
+
+            if (ST_TRUTHYP(proc))
+            {
+                StObject lambda = ST_CDR(proc);
+                if (!escape_only_bodyP(ST_CDDR(lambda), set_minus(ks, param_list(ST_CADR(lambda)))))
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            if (St_SetMemberP(ST_CADR(x), ks) || !escape_onlyP(ST_CADDR(x), ks))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (!escape_onlyP(x, ks))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// true if receiver is (lambda (k) body ...) where k does not outlive the call
+static bool escape_receiverP(StObject receiver)
+{
+    if (!ST_PAIRP(receiver) || ST_CAR(receiver) != I("lambda") || St_Length(receiver) < 3)
+    {
+        return false;
+    }
+
+    StObject params = ST_CADR(receiver);
+
+    return ST_PAIRP(params)
+        && ST_NULLP(ST_CDR(params))
+        && ST_SYMBOLP(ST_CAR(params))
+        && escape_only_bodyP(ST_CDDR(receiver), params);
+}
+
+// (call/ec receiver)
+// => (escape (escape-end next) (receiver (argument (apply))))
+//
+//  k        argument
+//  frame    returning to (escape-end next)
+//  escape   popped by escape-end
+//
+// A receiver (lambda (k) body ...) without internal definitions is not
+// closed; body runs with k bound on the stack.
+static StObject compile_escape(StCompileContext *ctx, StObject receiver, StObject next)
+{
+    StObject ret = ST_LIST2(I("escape-end"), next);
+    StCompileContext nctx = *ctx;
+
+    if (ST_PAIRP(receiver) && ST_CAR(receiver) == I("lambda") && St_Length(receiver) >= 3)
+    {
+        StObject params = ST_CADR(receiver);
+        StObject body = ST_CDDR(receiver);
+
+        if (ST_PAIRP(params) && ST_NULLP(ST_CDR(params)) && ST_SYMBOLP(ST_CAR(params)) &&
+            ST_NULLP(find_define(body)))
+        {
+            nctx.depth = ctx->depth + 5; // escape and frame
+            StObject c = compile_let_body(&nctx, params, body, ST_LIST2(I("return"), St_Integer(0)));
+            return ST_LIST3(I("escape"), ret, ST_LIST2(I("argument"), c));
+        }
+    }
+
+    nctx.depth = ctx->depth + 6; // escape, frame and the argument
+    return ST_LIST3(I("escape"), ret,
+                    ST_LIST2(I("argument"), compile(&nctx, receiver, ST_LIST1(I("apply")))));
+}
+
+// keywords such as :fuel evaluate to themselves
+static bool keywordp(StObject x)
+{
+    const char *name = ST_SYMBOL_VALUE(x);
+    return name[0] == ':' && name[1] != '\0';
+}
+
+static StObject compile(StCompileContext *ctx, StObject x, StObject next)
+{
+    if (ST_SYMBOLP(x))
+    {
+        if (keywordp(x))
+        {
+            return ST_LIST3(I("constant"), x, next);
+        }
+
+        return compile_refer(ctx, x, St_SetMemberP(x, ctx->sets) ? ST_LIST2(I("indirect"), next) : next);
+    }
+
+    if (ST_PAIRP(x))
+    {
+        StObject car = ST_CAR(x);
+
+        if (car == I("quote"))
+        {
+            StObject obj = ST_CADR(x);
+
+            return ST_LIST3(I("constant"), obj, next);
+        }
+
+        if (car == I("---case---"))
+        {
+            if (St_Length(x) < 2)
+            {
+                St_Error("compile: malformed case");
+            }
+
+            return compile_case(ctx, ST_CADR(x), ST_CDDR(x), next);
+        }
+
+        if (car == I("---call-with-values---"))
+        {
+            if (St_Length(x) != 3)
+            {
+                St_Error("compile: malformed call-with-values");
+            }
+
+            return compile_call_with_values(ctx, ST_CADR(x), ST_CADDR(x), next);
+        }
+
+        if (car == I("---handler---"))
+        {
+            // (---handler--- unwind? handler thunk)
+            // =>
+            //  handler       ...
+            //  push-handler  unwind? (pop-handler next)
+            //  thunk         called in a frame above the handler record
+            if (St_Length(x) != 4)
+            {
+                St_Error("compile: malformed handler");
+            }
+
+            StCompileContext nctx = *ctx;
+            nctx.depth = ctx->depth + 9; // handler record and frame
+
+            StObject c = compile_call(&nctx, TLIST1(ST_CADDDR(x)), ST_LIST2(I("return"), St_Integer(0)));
+            c = ST_LIST4(I("push-handler"), ST_CADR(x), ST_LIST2(I("pop-handler"), next), c);
+            return compile(ctx, ST_CADDR(x), c);
+        }
+
+        if (car == I("---wind---"))
+        {
+            // (---wind--- before thunk after)
+            // =>
+            //  before, thunk and after  argument
+            //  before                   called in a frame
+            //  wind-push
+            //  thunk                    called in a frame
+            //  wind-pop                 pushes the values of thunk
+            //  after                    called in a frame
+            //  wind-end                 pops them and the arguments
+            if (St_Length(x) != 4)
+            {
+                St_Error("compile: malformed dynamic-wind");
+            }
+
+            int d = ctx->depth;
+            StObject c = ST_LIST3(I("frame"),
+                                  ST_LIST2(I("wind-end"), next),
+                                  ST_LIST3(I("refer-local"), St_Integer(-(d + 2) - 1), ST_LIST1(I("apply"))));
+            c = ST_LIST3(I("frame"),
+                         ST_LIST2(I("wind-pop"), c),
+                         ST_LIST3(I("refer-local"), St_Integer(-(d + 1) - 1), ST_LIST1(I("apply"))));
+            c = ST_LIST3(I("frame"),
+                         ST_LIST2(I("wind-push"), c),
+                         ST_LIST3(I("refer-local"), St_Integer(-d - 1), ST_LIST1(I("apply"))));
+
+            int j = 3;
+
+            ST_FOREACH(p, treverse(ST_CDR(x))) {
+                StCompileContext cctx = *ctx;
+                cctx.depth = d + --j;
+                c = compile(&cctx, ST_CAR(p), ST_LIST2(I("argument"), c));
+            }
+            return c;
+        }
+
+        if (car == I("---parameterize---"))
+        {
+            // (---parameterize--- param value ... thunk)
+            // =>
+            //  param, value ... and thunk  argument
+            //  parameterize                n
+            //  thunk                       called in a frame
+            //  parameterize-end            n
+            int len = St_Length(ST_CDR(x));
+            if (len % 2 != 1)
+            {
+                St_Error("compile: malformed parameterize");
+            }
+
+            int n = len / 2;
+            StObject c = ST_LIST3(I("frame"),
+                                  ST_LIST3(I("parameterize-end"), St_Integer(n), next),
+                                  ST_LIST3(I("refer-local"), St_Integer(-(ctx->depth + len - 1) - 1),
+                                           ST_LIST1(I("apply"))));
+            c = ST_LIST3(I("parameterize"), St_Integer(n), c);
+            int j = len;
+
+            ST_FOREACH(p, treverse(ST_CDR(x))) {
+                StCompileContext cctx = *ctx;
+                cctx.depth = ctx->depth + --j;
+                c = compile(&cctx, ST_CAR(p), ST_LIST2(I("argument"), c));
+            }
+            return c;
+        }
+
+        if (car == I("---case-lambda---"))
+        {
+            // (---case-lambda--- clause ...)
+            // =>
+            //  clause       ...
+            //  argument     ...
+            //  case-lambda  n
+            int n = St_Length(ST_CDR(x));
+            StObject c = ST_LIST3(I("case-lambda"), St_Integer(n), next);
+            int j = n;
+
+            ST_FOREACH(p, treverse(ST_CDR(x))) {
+                StCompileContext cctx = *ctx;
+                cctx.depth = ctx->depth + --j;
+                c = compile(&cctx, ST_CAR(p), ST_LIST2(I("argument"), c));
+            }
+
+            return c;
+        }
+
+        if (car == I("---let---") ||
+            car == I("---let*---"))
+        {
+            int len = St_Length(x);
+            if (len < 2)
+            {
+                St_Error("compile: malformed let");
+            }
+
+            StObject bindings = ST_CADR(x);
+            StObject body = ST_CDDR(x);
+
+            StObject vars = Nil, vt = Nil;
+            StObject exprs = Nil, et = Nil;
+
+            ST_FOREACH(p, bindings) {
+                ST_BIND2("let binding", ST_CAR(p), s, exp);
+
+                if (!ST_SYMBOLP(s))
+                {
+                    St_Error("let bining: symbol reuqired");
+                }
+
+                if (St_SetMemberP(s, vars))
+                {
+                    St_Error("let binding: multiple symbol: %s", ST_SYMBOL_VALUE(s));
+                }
+
+                T_APPEND1(vars, vt, s);
+                T_APPEND1(exprs, et, exp);
+            }
+
+            return compile_let(ctx, vars, exprs, body, next);
+        }
+
+        if (car == I("lambda"))
+        {
+            StObject params = ST_CADR(x);
+            StObject body = ST_CDDR(x);
+            StObject p;
+            int arity = 0;
+            StObject vars = Nil;
+            StObject tail = Nil;
+
+            for (p = params; ST_PAIRP(p); p = ST_CDR(p))
+            {
+                arity++;
+                T_APPEND1(vars, tail, ST_CAR(p));
+            }
+
+            if (!ST_NULLP(p))
+            {
+                arity = -arity - 1;
+                T_APPEND1(vars, tail, p);
+            }
+
+            body = lift_local_procedures(ctx, vars, body);
+
+            StObject defs = find_define(body);
+            StObject extended_vars = set_append(defs, vars);
+            StObject free = Nil;
+
+            // Only variables bound lexically around the lambda are captured.
+            // The others refer to the module.
+            ST_FOREACH(p, find_free(body, set_union(extended_vars, primitiveSyntaxes()))) {
+                if (lexically_boundP(ctx, ST_CAR(p)))
+                {
+                    free = tcons(ST_CAR(p), free);
+                }
+                else
+                {
+                    module_add(ctx->module, ST_CAR(p));
+                }
+            }
+
+            StObject sets = find_sets(body, vars);
+
+            int len_vars = St_Length(extended_vars);
+
+            StCompileContext nctx = *ctx;
+
+            nctx.env = tcons(extended_vars, free);
+            nctx.sets = set_union(sets,
+                                    set_union(defs,
+                                                set_intersect(ctx->sets, free)));
+            nctx.toplevel = false;
+            nctx.lets = Nil;
+            nctx.depth = 0;
+
+            StObject body_c = compile_body(&nctx, body, ST_LIST2(I("return"), St_Integer(len_vars)));
+
+            if (abs(arity) != len_vars)
+            {
+                int to_extend = len_vars - abs(arity);
+                body_c = ST_LIST3(I("extend"), St_Integer(to_extend), body_c);
+            }
+
+            return collect_free(ctx, free,
+                                ST_LIST5(I("close"),
+                                         St_Integer(arity),
+                                         St_Integer(St_Length(free)),
+                                         make_boxes(sets, vars, body_c, 0),
+                                         next));
+        }
+
+        if (car == I("begin"))
+        {
+            return compile_body(ctx, ST_CDR(x), next);
+        }
+
+        if (car == I("if"))
+        {
             StObject testE = ST_CADR(x);
             StObject thenE = ST_CADDR(x);
             StObject elseE = ST_CDR(ST_CDDR(x));
@@ -634,14 +1938,21 @@ static StObject compile(StCompileContext *ctx, StObject x, StObject next)
             return compile(ctx, x2, compile_assign(ctx, var, next));
         }
 
+        if (car == I("call/ec") || (car == I("call/cc") && escape_receiverP(ST_CADR(x))))
+        {
+            return compile_escape(ctx, ST_CADR(x), next);
+        }
+
         if (car == I("call/cc"))
         {
             StObject x2 = ST_CADR(x);
+            StCompileContext nctx = *ctx;
+            nctx.depth = ctx->depth + 5; // frame and the continuation
             return ST_LIST3(I("frame"),
                             next,
                             ST_LIST2(I("conti"),
                                      ST_LIST2(I("argument"),
-                                              compile(ctx, x2, tailP(next)
+                                              compile(&nctx, x2, tailP(next)
                                                       ? ST_LIST4(I("shift"), St_Integer(1), ST_CADR(next), ST_LIST1(I("apply")))
                                                       : ST_LIST1(I("apply"))))));
         }
@@ -657,6 +1968,11 @@ static StObject compile(StCompileContext *ctx, StObject x, StObject next)
             StObject var = ST_CADR(x);
             StObject v = ST_CADDR(x);
 
+            if (ctx->toplevel && ST_NULLP(ctx->lets) && ST_PAIRP(v) && ST_CAR(v) == I("lambda"))
+            {
+                return compile_define_lambda(ctx, var, v, next);
+            }
+
             return compile(ctx, v, compile_assign(ctx, var, next));
         }
 
@@ -668,6 +1984,25 @@ static StObject compile(StCompileContext *ctx, StObject x, StObject next)
             return compile(ctx, v, ST_LIST3(I("macro"), var, compile_assign(ctx, var, next)));
         }
 
+        if (car == I("define-syntax"))
+        {
+            if (St_Length(x) != 3 || !ST_SYMBOLP(ST_CADR(x)))
+            {
+                St_Error("define-syntax: malformed define-syntax");
+            }
+
+            StObject var = ST_CADR(x);
+            StObject v = ST_CADDR(x);
+
+            if (!ST_PAIRP(v) || ST_CAR(v) != I("syntax-rules"))
+            {
+                St_Error("define-syntax: syntax-rules required");
+            }
+
+            return ST_LIST3(I("constant"), St_MakeSyntaxRules(v),
+                            ST_LIST3(I("macro"), var, compile_assign(ctx, var, next)));
+        }
+
         if (car == I("and"))
         {
             return compile_and(ctx, ST_CDR(x), next);
@@ -678,16 +2013,7 @@ static StObject compile(StCompileContext *ctx, StObject x, StObject next)
             return compile_or(ctx, ST_CDR(x), next);
         }
 
-        // else clause
-        for (StObject args = ST_CDR(x), c = compile(ctx, ST_CAR(x), tailP(next) ? ST_LIST4(I("shift"), St_Integer(St_Length(ST_CDR(x))), ST_CADR(next), ST_LIST1(I("apply"))) : ST_LIST1(I("apply")));
-             ;
-             c = compile(ctx, ST_CAR(args), ST_LIST2(I("argument"), c)), args = ST_CDR(args))
-        {
-            if (ST_NULLP(args))
-            {
-                return tailP(next) ? c : ST_LIST3(I("frame"), next, c);
-            }
-        }
+        return compile_call(ctx, x, next);
     } // pair
 
     return ST_LIST3(I("constant"), x, next);
@@ -695,7 +2021,12 @@ static StObject compile(StCompileContext *ctx, StObject x, StObject next)
 
 StObject St_Compile(StObject expr, StObject module, StObject next)
 {
-    return compile(&(StCompileContext){ module, St_Cons(Nil, Nil), Nil, true, 0 }, syntaxexpand(module, macroexpand(module, expr)), next);
+    StRegionMark mark = St_RegionMark();
+    StObject x = expand(module, expr);
+    StObject code = compile(&(StCompileContext){ module, tcons(Nil, Nil), Nil, true, Nil, 0, Nil, Nil }, x, next);
+
+    St_RegionRelease(mark);
+    return code;
 }
 
 StObject St_MacroExpand(StObject module, StObject expr)
@@ -705,5 +2036,5 @@ StObject St_MacroExpand(StObject module, StObject expr)
 
 StObject St_SyntaxExpand(StObject module, StObject expr)
 {
-    return syntaxexpand(module, expr);
+    return expand(module, expr);
 }
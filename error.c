@@ -0,0 +1,152 @@
+#include <stdio.h>
+
+#include "lisp.h"
+#include "subr.h"
+
+// Error objects
+//
+// Errors signaled by St_Error and the error procedure are raised as error
+// objects carrying a message and a list of irritants.
+
+struct StErrorObjectRec
+{
+    ST_EXTERNAL_OBJECT_HEADER;
+    StObject message;
+    StObject irritants;
+};
+typedef struct StErrorObjectRec *StErrorObject;
+#define ST_ERROR_OBJECT(x) ((StErrorObject)(x))
+
+static void display(StObject obj, StObject port)
+{
+    St_WriteCString("#<error ", port);
+    St_Display(ST_ERROR_OBJECT(obj)->message, port);
+    St_WriteCString(">", port);
+}
+
+static bool equalp(StObject lhs, StObject rhs)
+{
+    return lhs == rhs;
+}
+
+static StExternalTypeInfo ErrorObjectTypeInfo = (StExternalTypeInfo) { "<error-object>", display, equalp };
+
+StObject St_MakeErrorObject(StObject message, StObject irritants)
+{
+    StErrorObject o = St_Alloc2(TEXTERNAL, sizeof(struct StErrorObjectRec));
+
+    o->type_info = &ErrorObjectTypeInfo;
+    o->message = message;
+    o->irritants = irritants;
+
+    return (StObject)o;
+}
+
+bool St_ErrorObjectP(StObject obj)
+{
+    return ST_EXTERNALP(obj) && ST_EXTERNAL_TYPE_INFO(obj) == &ErrorObjectTypeInfo;
+}
+
+StObject St_ErrorObjectMessage(StObject obj)
+{
+    return ST_ERROR_OBJECT(obj)->message;
+}
+
+StObject St_ErrorObjectIrritants(StObject obj)
+{
+    return ST_ERROR_OBJECT(obj)->irritants;
+}
+
+// Reports an exception nobody handled and exits as St_Error used to.
+void St_ReportUncaught(StObject obj)
+{
+    StObject port = St_CurrentErrorPort;
+
+    if (St_ErrorObjectP(obj))
+    {
+        St_Display(St_ErrorObjectMessage(obj), port);
+        ST_FOREACH(p, St_ErrorObjectIrritants(obj)) {
+            St_WriteCString(" ", port);
+            St_Display(ST_CAR(p), port);
+        }
+    }
+    else
+    {
+        St_WriteCString("uncaught exception: ", port);
+        St_Display(obj, port);
+    }
+
+    exit(1);
+}
+
+static StObject subr_error(StCallInfo *cinfo)
+{
+    if (cinfo->count < 1)
+    {
+        St_Error("error: wrong number of arguments");
+    }
+
+    StObject irritants = Nil;
+    for (int i = cinfo->count - 1; i > 0; i--) {
+        irritants = St_Cons(St_Arg(cinfo, i), irritants);
+    }
+
+    St_Raise(St_MakeErrorObject(St_Arg(cinfo, 0), irritants), false);
+}
+
+static StObject subr_raise(StCallInfo *cinfo)
+{
+    ST_ARGS1("raise", cinfo, obj);
+
+    St_Raise(obj, false);
+}
+
+static StObject subr_raise_continuable(StCallInfo *cinfo)
+{
+    ST_ARGS1("raise-continuable", cinfo, obj);
+
+    St_Raise(obj, true);
+}
+
+static StObject subr_error_objectp(StCallInfo *cinfo)
+{
+    ST_ARGS1("error-object?", cinfo, obj);
+
+    return St_ErrorObjectP(obj) ? True : False;
+}
+
+static StObject subr_error_object_message(StCallInfo *cinfo)
+{
+    ST_ARGS1("error-object-message", cinfo, obj);
+
+    if (!St_ErrorObjectP(obj))
+    {
+        St_Error("error-object-message: error object required");
+    }
+
+    return St_ErrorObjectMessage(obj);
+}
+
+static StObject subr_error_object_irritants(StCallInfo *cinfo)
+{
+    ST_ARGS1("error-object-irritants", cinfo, obj);
+
+    if (!St_ErrorObjectP(obj))
+    {
+        St_Error("error-object-irritants: error object required");
+    }
+
+    return St_ErrorObjectIrritants(obj);
+}
+
+void St_InitError(void)
+{
+    StObject m = GlobalModule;
+
+    St_AddSubr(m, "error", subr_error);
+    St_AddSubr(m, "raise", subr_raise);
+    St_AddSubr(m, "raise-continuable", subr_raise_continuable);
+    St_AddSubr(m, "error-object?", subr_error_objectp);
+    St_AddSubr(m, "error-object-message", subr_error_object_message);
+    St_AddSubr(m, "error-object-irritants", subr_error_object_irritants);
+}
@@ -0,0 +1,488 @@
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "lisp.h"
+#include "subr.h"
+
+// Event loop
+//
+// on-readable and on-writable call a procedure with the port each time its
+// fd is ready; set-timer calls a thunk once after a delay. event-loop-run
+// dispatches them until none is left or event-loop-stop is called.
+// Closing a port cancels its events.
+//
+// Readiness is waited for with epoll on Linux and with poll() elsewhere.
+// A port may hold input in its buffer although its fd has nothing more to
+// read, so readable events of such ports are dispatched again without
+// waiting.
+
+enum { EVENT_READABLE, EVENT_WRITABLE, EVENT_TIMER };
+
+struct StEventRec
+{
+    ST_EXTERNAL_OBJECT_HEADER;
+    int kind;
+    StObject port;
+    StObject proc;
+    long long due; // of timers, in milliseconds of CLOCK_MONOTONIC
+    bool active;
+};
+typedef struct StEventRec *StEvent;
+#define ST_EVENT(x) ((StEvent)(x))
+
+static StObject IoEvents = Nil; // active readable and writable events
+static StObject Timers = Nil;   // active timers by due time
+static StObject Pending = Nil;  // readable events of ports with buffered input
+static bool Stopped;
+
+static void display(StObject obj __attribute__((unused)), StObject port)
+{
+    St_WriteCString("#<event>", port);
+}
+
+static bool equalp(StObject lhs, StObject rhs)
+{
+    return lhs == rhs;
+}
+
+static StExternalTypeInfo EventTypeInfo = (StExternalTypeInfo) { "<event>", display, equalp };
+
+static bool eventp(StObject obj)
+{
+    return ST_EXTERNALP(obj) && ST_EXTERNAL_TYPE_INFO(obj) == &EventTypeInfo;
+}
+
+static StObject make_event(int kind, StObject port, StObject proc)
+{
+    StEvent e = St_Alloc2(TEXTERNAL, sizeof(struct StEventRec));
+
+    e->type_info = &EventTypeInfo;
+    e->kind = kind;
+    e->port = port;
+    e->proc = proc;
+    e->due = 0;
+    e->active = true;
+
+    return (StObject)e;
+}
+
+static long long now_ms(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+static StObject remove_event(StObject list, StObject e)
+{
+    StObject h = Nil, t = Nil;
+
+    ST_FOREACH(p, list) {
+        if (ST_CAR(p) != e)
+        {
+            ST_APPEND1(h, t, ST_CAR(p));
+        }
+    }
+
+    return h;
+}
+
+static int fd_of(StObject e)
+{
+    return ST_FDPORT_FD(ST_EVENT(e)->port);
+}
+
+static void call_event(StObject e)
+{
+    StEvent ev = ST_EVENT(e);
+
+    if (ev->kind == EVENT_TIMER)
+    {
+        St_Apply(ev->proc, &(StCallInfo){ NULL, 0, 0 });
+        return;
+    }
+
+    StObject v = St_MakeVector(1);
+    St_VectorSet(v, 0, ev->port);
+    St_Apply(ev->proc, &(StCallInfo){ ST_VECTOR(v), 1, 1 });
+
+    if (ev->active && ev->kind == EVENT_READABLE && St_PortBufferedP(ev->port))
+    {
+        Pending = St_Cons(e, Pending);
+    }
+}
+
+#ifdef __linux__
+
+// epoll keeps one registration per fd for all of its events
+static int Epoll = -1;
+static StObject FdEvents = Nil; // fd => active io events
+
+static uint32_t epoll_mask(StObject events)
+{
+    uint32_t mask = 0;
+
+    ST_FOREACH(p, events) {
+        mask |= ST_EVENT(ST_CAR(p))->kind == EVENT_READABLE ? EPOLLIN : EPOLLOUT;
+    }
+
+    return mask;
+}
+
+static void backend_update(int fd, StObject before, StObject after)
+{
+    if (Epoll == -1)
+    {
+        Epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (Epoll == -1)
+        {
+            St_Error("event: epoll_create1 failed");
+        }
+    }
+
+    struct epoll_event ev = { .events = epoll_mask(after), .data.fd = fd };
+    int op = ST_NULLP(before) ? EPOLL_CTL_ADD : ST_NULLP(after) ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    int r = epoll_ctl(Epoll, op, fd, &ev);
+
+    // a closed fd has left the epoll set already, and its number may have
+    // been reused by another fd
+    if (r == -1 && op == EPOLL_CTL_MOD && errno == ENOENT)
+    {
+        r = epoll_ctl(Epoll, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    if (r == -1 && op != EPOLL_CTL_DEL)
+    {
+        St_Error("event: epoll_ctl failed");
+    }
+}
+
+static void backend_add(StObject e)
+{
+    if (ST_NULLP(FdEvents))
+    {
+        FdEvents = St_MakeHashtable(16);
+    }
+
+    StObject fd = St_Integer(fd_of(e));
+    StObject before = St_HashtableRef(FdEvents, fd, Nil);
+    StObject after = St_Cons(e, before);
+
+    St_HashtableSet(FdEvents, fd, after);
+    backend_update(fd_of(e), before, after);
+}
+
+static void backend_remove(StObject e)
+{
+    StObject fd = St_Integer(fd_of(e));
+    StObject before = St_HashtableRef(FdEvents, fd, Nil);
+    StObject after = remove_event(before, e);
+
+    St_HashtableSet(FdEvents, fd, after);
+    backend_update(fd_of(e), before, after);
+}
+
+#define MAX_EPOLL_EVENTS 64
+
+static void backend_wait(int timeout)
+{
+    struct epoll_event evs[MAX_EPOLL_EVENTS];
+
+    int n = epoll_wait(Epoll, evs, MAX_EPOLL_EVENTS, timeout);
+    if (n == -1)
+    {
+        if (errno == EINTR)
+        {
+            return;
+        }
+        St_Error("event: epoll_wait failed");
+    }
+
+    for (int i = 0; i < n; i++) {
+        uint32_t r = evs[i].events;
+
+        ST_FOREACH(p, St_HashtableRef(FdEvents, St_Integer(evs[i].data.fd), Nil)) {
+            StObject e = ST_CAR(p);
+            uint32_t want = ST_EVENT(e)->kind == EVENT_READABLE ? EPOLLIN : EPOLLOUT;
+
+            if (ST_EVENT(e)->active && (r & (want | EPOLLHUP | EPOLLERR)))
+            {
+                call_event(e);
+            }
+        }
+    }
+}
+
+#else
+
+static short poll_events(StObject e)
+{
+    return ST_EVENT(e)->kind == EVENT_READABLE ? POLLIN : POLLOUT;
+}
+
+static void backend_add(StObject e __attribute__((unused)))
+{
+}
+
+static void backend_remove(StObject e __attribute__((unused)))
+{
+}
+
+static void backend_wait(int timeout)
+{
+    int n = St_Length(IoEvents);
+    struct pollfd fds[n];
+    StObject events[n];
+    int i = 0;
+
+    ST_FOREACH(p, IoEvents) {
+        events[i] = ST_CAR(p);
+        fds[i].fd = fd_of(ST_CAR(p));
+        fds[i].events = poll_events(ST_CAR(p));
+        fds[i].revents = 0;
+        i++;
+    }
+
+    if (poll(fds, n, timeout) == -1)
+    {
+        if (errno == EINTR)
+        {
+            return;
+        }
+        St_Error("event: poll failed");
+    }
+
+    for (i = 0; i < n; i++) {
+        if (fds[i].revents != 0 && ST_EVENT(events[i])->active)
+        {
+            call_event(events[i]);
+        }
+    }
+}
+
+#endif
+
+static void cancel_event(StObject e)
+{
+    StEvent ev = ST_EVENT(e);
+
+    if (!ev->active)
+    {
+        return;
+    }
+
+    ev->active = false;
+
+    if (ev->kind == EVENT_TIMER)
+    {
+        Timers = remove_event(Timers, e);
+    }
+    else
+    {
+        IoEvents = remove_event(IoEvents, e);
+        backend_remove(e);
+    }
+}
+
+static StObject add_io_event(const char *name, StCallInfo *cinfo, int kind)
+{
+    if (cinfo->count != 2)
+    {
+        St_Error("%s: wrong number of arguments", name);
+    }
+
+    ARG(port, 0);
+    ARG(proc, 1);
+
+    if (!ST_FDPORTP(port) || St_PortClosedP(port))
+    {
+        St_Error("%s: open port required", name);
+    }
+
+    if (ST_FDPORT_FD(port) < 0)
+    {
+        St_Error("%s: fd port required", name);
+    }
+
+    if (!ST_PROCEDUREP(proc))
+    {
+        St_Error("%s: procedure required", name);
+    }
+
+    StObject e = make_event(kind, port, proc);
+
+    IoEvents = St_Cons(e, IoEvents);
+    backend_add(e);
+
+    if (kind == EVENT_READABLE && St_PortBufferedP(port))
+    {
+        Pending = St_Cons(e, Pending);
+    }
+
+    return e;
+}
+
+static StObject subr_on_readable(StCallInfo *cinfo)
+{
+    return add_io_event("on-readable", cinfo, EVENT_READABLE);
+}
+
+static StObject subr_on_writable(StCallInfo *cinfo)
+{
+    return add_io_event("on-writable", cinfo, EVENT_WRITABLE);
+}
+
+static StObject subr_set_timer(StCallInfo *cinfo)
+{
+    ST_ARGS2("set-timer", cinfo, ms, proc);
+
+    if (!ST_INTP(ms) || ST_INT_VALUE(ms) < 0)
+    {
+        St_Error("set-timer: non-negative integer required");
+    }
+
+    if (!ST_PROCEDUREP(proc))
+    {
+        St_Error("set-timer: procedure required");
+    }
+
+    StObject e = make_event(EVENT_TIMER, False, proc);
+    ST_EVENT(e)->due = now_ms() + ST_INT_VALUE(ms);
+
+    // timers due at the same time run in the order they are set
+    StObject h = Nil, t = Nil;
+    StObject p = Timers;
+    for (; !ST_NULLP(p) && ST_EVENT(ST_CAR(p))->due <= ST_EVENT(e)->due; p = ST_CDR(p)) {
+        ST_APPEND1(h, t, ST_CAR(p));
+    }
+    ST_APPEND1(h, t, e);
+    ST_CDR_SET(t, p);
+    Timers = h;
+
+    return e;
+}
+
+static StObject subr_cancel_event(StCallInfo *cinfo)
+{
+    ST_ARGS1("cancel-event", cinfo, e);
+
+    if (!eventp(e))
+    {
+        St_Error("cancel-event: event required");
+    }
+
+    cancel_event(e);
+
+    return Nil;
+}
+
+// called before the fd of a port is closed, since another fd may take
+// its number
+void St_CancelPortEvents(StObject port)
+{
+    ST_FOREACH(p, IoEvents) {
+        if (ST_EVENT(ST_CAR(p))->port == port)
+        {
+            cancel_event(ST_CAR(p));
+        }
+    }
+}
+
+// drops events of the ports closed while they were waited for
+static void drop_closed(void)
+{
+    ST_FOREACH(p, IoEvents) {
+        if (St_PortClosedP(ST_EVENT(ST_CAR(p))->port))
+        {
+            cancel_event(ST_CAR(p));
+        }
+    }
+}
+
+static StObject subr_event_loop_run(StCallInfo *cinfo)
+{
+    ST_ARGS0("event-loop-run", cinfo);
+
+    Stopped = false;
+
+    while (!Stopped)
+    {
+        drop_closed();
+
+        if (ST_NULLP(IoEvents) && ST_NULLP(Timers))
+        {
+            break;
+        }
+
+        int timeout = -1;
+
+        if (!ST_NULLP(Pending))
+        {
+            timeout = 0;
+        }
+        else if (!ST_NULLP(Timers))
+        {
+            long long d = ST_EVENT(ST_CAR(Timers))->due - now_ms();
+            timeout = d < 0 ? 0 : d > INT_MAX ? INT_MAX : (int)d;
+        }
+
+        StObject pending = Pending;
+        Pending = Nil;
+
+        if (ST_NULLP(IoEvents))
+        {
+            if (timeout > 0)
+            {
+                poll(NULL, 0, timeout);
+            }
+        }
+        else
+        {
+            backend_wait(timeout);
+        }
+
+        ST_FOREACH(p, pending) {
+            StObject e = ST_CAR(p);
+            if (!Stopped && ST_EVENT(e)->active && St_PortBufferedP(ST_EVENT(e)->port))
+            {
+                call_event(e);
+            }
+        }
+
+        long long now = now_ms();
+        while (!Stopped && !ST_NULLP(Timers) && ST_EVENT(ST_CAR(Timers))->due <= now)
+        {
+            StObject e = ST_CAR(Timers);
+            cancel_event(e);
+            call_event(e);
+        }
+    }
+
+    return Nil;
+}
+
+static StObject subr_event_loop_stop(StCallInfo *cinfo)
+{
+    ST_ARGS0("event-loop-stop", cinfo);
+
+    Stopped = true;
+
+    return Nil;
+}
+
+void St_InitEvent(void)
+{
+    StObject m = GlobalModule;
+
+    St_AddSubr(m, "on-readable", subr_on_readable);
+    St_AddSubr(m, "on-writable", subr_on_writable);
+    St_AddSubr(m, "set-timer", subr_set_timer);
+    St_AddSubr(m, "cancel-event", subr_cancel_event);
+    St_AddSubr(m, "event-loop-run", subr_event_loop_run);
+    St_AddSubr(m, "event-loop-stop", subr_event_loop_stop);
+}
@@ -18,9 +18,10 @@ void St_Error(const char *fmt, ...)
 
     va_end(args);
 
-    St_WriteCString(rptr, St_CurrentErrorPort);
+    StObject message = St_MakeStringFromCString(rptr);
+    free(rptr);
 
-    exit(1);
+    St_Raise(St_MakeErrorObject(message, Nil), false);
 }
 
 void *St_Alloc2(int type, size_t size)
@@ -544,32 +545,146 @@ int St_DVectorPush(StObject vector, StObject obj)
     return len;
 }
 
+// hashtable
+//
+// (count . buckets) where each bucket is an alist. Keys are compared
+// with eqv?, so symbols are hashed by address and fixnums by value.
+
+static size_t hashtable_hash(StObject key, size_t nbuckets)
+{
+    uintptr_t h = (uintptr_t)key;
+
+    h ^= h >> 17;
+    h *= 0x9e3779b1;
+    h ^= h >> 13;
+
+    return h % nbuckets;
+}
+
+StObject St_MakeHashtable(int capa)
+{
+    if (capa <= 0)
+    {
+        capa = 16;
+    }
+    return St_Cons(St_Integer(0), St_MakeVectorWithInitValue(capa, Nil));
+}
+
+static StObject hashtable_entry(StObject table, StObject key)
+{
+    StObject buckets = ST_CDR(table);
+    StObject bucket = ST_VECTOR_DATA(buckets)[hashtable_hash(key, ST_VECTOR_LENGTH(buckets))];
+
+    ST_FOREACH(p, bucket) {
+        if (St_EqvP(ST_CAAR(p), key))
+        {
+            return ST_CAR(p);
+        }
+    }
+    return False;
+}
+
+StObject St_HashtableRef(StObject table, StObject key, StObject fallback)
+{
+    StObject e = hashtable_entry(table, key);
+
+    return ST_FALSEP(e) ? fallback : ST_CDR(e);
+}
+
+static void hashtable_grow(StObject table)
+{
+    StObject old = ST_CDR(table);
+    size_t len = ST_VECTOR_LENGTH(old);
+    StObject buckets = St_MakeVectorWithInitValue(len * 2, Nil);
+
+    for (size_t i = 0; i < len; i++) {
+        ST_FOREACH(p, ST_VECTOR_DATA(old)[i]) {
+            size_t h = hashtable_hash(ST_CAAR(p), len * 2);
+            ST_VECTOR_DATA(buckets)[h] = St_Cons(ST_CAR(p), ST_VECTOR_DATA(buckets)[h]);
+        }
+    }
+
+    ST_CDR_SET(table, buckets);
+}
+
+void St_HashtableSet(StObject table, StObject key, StObject value)
+{
+    StObject e = hashtable_entry(table, key);
+
+    if (!ST_FALSEP(e))
+    {
+        ST_CDR_SET(e, value);
+        return;
+    }
+
+    int count = St_HashtableCount(table);
+    if ((size_t)count >= ST_VECTOR_LENGTH(ST_CDR(table)))
+    {
+        hashtable_grow(table);
+    }
+
+    StObject buckets = ST_CDR(table);
+    size_t h = hashtable_hash(key, ST_VECTOR_LENGTH(buckets));
+    ST_VECTOR_DATA(buckets)[h] = St_Acons(key, value, ST_VECTOR_DATA(buckets)[h]);
+    ST_CAR_SET(table, St_Integer(count + 1));
+}
+
+int St_HashtableCount(StObject table)
+{
+    return ST_INT_VALUE(ST_CAR(table));
+}
+
+// module
+//
+// A module is a vector of three dynamic vectors sharing their indices:
+//
+//   bindings:   (symbol . value)
+//   dependents: list of (insn . deopt) recorded by the compiler, or False
+//   infos:      what the compiler knows about the defining expression
+//
+// and a hashtable from symbols to those indices.
+//
+// While a binding has never been reassigned after its definition, the
+// compiler may embed its value into the code (see compile.c). Each such
+// instruction is recorded as a dependent. When the binding is
+// reassigned, the dependents are rewritten back to `deopt` in place and
+// the binding is marked as False (not constant) for good.
+
+#define BINDINGS(m)   ST_VECTOR_DATA(m)[0]
+#define DEPENDENTS(m) ST_VECTOR_DATA(m)[1]
+#define INFOS(m)      ST_VECTOR_DATA(m)[2]
+#define INDEX(m)      ST_VECTOR_DATA(m)[3]
+
 StObject St_MakeModule(StObject alist)
 {
     int size = St_Length(alist);
-    StObject v = St_MakeDVector(size, size);
+    StObject m = St_MakeVector(4);
+    BINDINGS(m) = St_MakeDVector(size, size);
+    DEPENDENTS(m) = St_MakeDVector(size, size);
+    INFOS(m) = St_MakeDVector(size, size);
+    INDEX(m) = St_MakeHashtable(size * 2);
 
     int i = 0;
     ST_FOREACH(p, alist) {
-        St_DVectorSet(v, i++, ST_CAR(p));
+        St_DVectorSet(BINDINGS(m), i, ST_CAR(p));
+        St_DVectorSet(DEPENDENTS(m), i, Nil);
+        St_DVectorSet(INFOS(m), i, Nil);
+        if (ST_FALSEP(St_HashtableRef(INDEX(m), ST_CAAR(p), False)))
+        {
+            St_HashtableSet(INDEX(m), ST_CAAR(p), St_Integer(i));
+        }
+        i++;
     }
 
-    return v;
+    return m;
 }
 
 #define NOT_FOUND (-1)
 
 static int module_contains(StObject m, StObject sym)
 {
-    int size = St_DVectorLength(m);
-    for (int i = 0; i < size; i++) {
-        StObject pair = St_DVectorRef(m, i);
-        if (ST_CAR(pair) == sym)
-        {
-            return i;
-        }
-    }
-    return NOT_FOUND;
+    StObject i = St_HashtableRef(INDEX(m), sym, False);
+    return ST_FALSEP(i) ? NOT_FOUND : ST_INT_VALUE(i);
 }
 
 StObject St_ModuleFind(StObject m, StObject sym)
@@ -577,39 +692,102 @@ StObject St_ModuleFind(StObject m, StObject sym)
     int i = module_contains(m, sym);
     return i == NOT_FOUND
         ? Unbound
-        : ST_CDR(St_DVectorRef(m, i));
+        : ST_CDR(St_DVectorRef(BINDINGS(m), i));
+}
+
+static int module_push(StObject m, StObject sym, StObject value)
+{
+    St_DVectorPush(DEPENDENTS(m), Nil);
+    St_DVectorPush(INFOS(m), Nil);
+    int i = St_DVectorPush(BINDINGS(m), St_Cons(sym, value));
+
+    // the first binding of a symbol wins as with a linear search
+    if (module_contains(m, sym) == NOT_FOUND)
+    {
+        St_HashtableSet(INDEX(m), sym, St_Integer(i));
+    }
+
+    return i;
 }
 
 int St_ModuleFindOrInitialize(StObject m, StObject sym, StObject init)
 {
     int i = module_contains(m, sym);
     return i == NOT_FOUND
-        ? St_DVectorPush(m, St_Cons(sym, init))
+        ? module_push(m, sym, init)
         : i;
 }
 
 void St_ModulePush(StObject m, StObject sym, StObject value)
 {
-    St_DVectorPush(m, St_Cons(sym, value));
+    module_push(m, sym, value);
+}
+
+static void module_deoptimize(StObject m, int idx)
+{
+    ST_FOREACH(p, St_DVectorRef(DEPENDENTS(m), idx)) {
+        StObject insn = ST_CAAR(p);
+        StObject deopt = ST_CDAR(p);
+        ST_CAR_SET(insn, ST_CAR(deopt));
+        ST_CDR_SET(insn, ST_CDR(deopt));
+    }
+
+    St_DVectorSet(DEPENDENTS(m), idx, False);
 }
 
 void St_ModuleSet(StObject m, int idx, StObject val)
 {
-    ST_CDR_SET(St_DVectorRef(m, idx), val);
+    StObject pair = St_DVectorRef(BINDINGS(m), idx);
+
+    if (!ST_UNBOUNDP(ST_CDR(pair)) && !ST_FALSEP(St_DVectorRef(DEPENDENTS(m), idx)))
+    {
+        module_deoptimize(m, idx);
+    }
+
+    ST_CDR_SET(pair, val);
 }
 
 StObject St_ModuleRef(StObject m, int i)
 {
-    return St_DVectorRef(m, i);
+    return St_DVectorRef(BINDINGS(m), i);
+}
+
+bool St_ModuleConstantP(StObject m, int idx)
+{
+    return !ST_UNBOUNDP(ST_CDR(St_DVectorRef(BINDINGS(m), idx)))
+        && !ST_FALSEP(St_DVectorRef(DEPENDENTS(m), idx));
+}
+
+void St_ModuleAddDependent(StObject m, int idx, StObject insn, StObject deopt)
+{
+    StObject deps = St_DVectorRef(DEPENDENTS(m), idx);
+
+    if (ST_FALSEP(deps))
+    {
+        St_Error("module: binding %s is not constant", ST_SYMBOL_VALUE(ST_CAR(St_ModuleRef(m, idx))));
+    }
+
+    St_DVectorSet(DEPENDENTS(m), idx, St_Acons(insn, deopt, deps));
+}
+
+StObject St_ModuleInfo(StObject m, int idx)
+{
+    return St_DVectorRef(INFOS(m), idx);
+}
+
+void St_ModuleSetInfo(StObject m, int idx, StObject info)
+{
+    St_DVectorSet(INFOS(m), idx, info);
 }
 
 StObject St_ModuleSymbols(StObject m)
 {
-    int len = St_DVectorLength(m);
+    StObject b = BINDINGS(m);
+    int len = St_DVectorLength(b);
     StObject syms = Nil;
 
     for (int i = 0; i < len; i++) {
-        syms = St_Cons(ST_CAR(St_DVectorRef(m, i)), syms);
+        syms = St_Cons(ST_CAR(St_DVectorRef(b, i)), syms);
     }
 
     return syms;
@@ -629,11 +807,16 @@ void St_AddSyntax(StObject module, const char *key, StSyntaxFunction syntax)
     St_ModulePush(module, St_Intern(key), s);
 }
 
-void St_AddSubr(StObject module, const char *key, StSubrFunction subr)
+StObject St_MakeSubr(const char *name, StSubrFunction subr)
 {
     StObject s = St_Alloc2(TSUBR, sizeof(struct StSubrRec));
     ST_SUBR_BODY(s) = subr;
-    ST_SUBR_NAME(s) = key;
+    ST_SUBR_NAME(s) = name;
 
-    St_ModulePush(module, St_Intern(key), s);
+    return s;
+}
+
+void St_AddSubr(StObject module, const char *key, StSubrFunction subr)
+{
+    St_ModulePush(module, St_Intern(key), St_MakeSubr(key, subr));
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -109,7 +110,9 @@ struct StBytevectorRec
 {
     ST_OBJECT_HEADER;
     size_t len;
-    uint8_t data[];
+    uint8_t *data; // storage, or a read-only mapping of a file
+    bool read_only;
+    uint8_t storage[];
 };
 typedef struct StBytevectorRec *StBytevector;
 #define ST_BYTEVECTOR(x) ((StBytevector)(x))
@@ -161,6 +164,11 @@ typedef struct StLambdaRec *StLambda;
 #define ST_LAMBDA_FREE(x) (ST_LAMBDA(x)->free)
 #define ST_LAMBDA_ARITY(x) (ST_LAMBDA(x)->arity)
 
+// A case-lambda is a lambda with this arity whose free is a vector of the
+// clause closures.
+#define ST_CASE_LAMBDA_ARITY INT_MIN
+#define ST_CASE_LAMBDAP(x) (ST_LAMBDAP(x) && ST_LAMBDA_ARITY(x) == ST_CASE_LAMBDA_ARITY)
+
 struct StMacroRec
 {
     ST_OBJECT_HEADER;
@@ -175,17 +183,33 @@ typedef struct StMacroRec *StMacro;
 struct StFdPortRec
 {
     ST_OBJECT_HEADER;
-    int fd;
+    const struct StPortClassRec *vtable; // how the port reads, writes and closes
+    int fd;          // -1 of memory ports
     ssize_t size;
-    int p;
-    uint8_t *buf;
+    ssize_t p;
+    uint8_t *buf;    // or the mapping of a file, or the data a memory port reads
+    size_t capacity; // of the buffer of fd ports
+    StObject object; // the string or bytevector a memory port reads
     bool need_to_close;
     bool eof;
     bool closed;
+    uint8_t *wbuf;   // output buffer, allocated by the first buffered write
+    size_t wsize;
+    size_t wcapacity;
+    int buffering;
+    void *uring; // io_uring state of file ports, see uring.c
 };
 typedef struct StFdPortRec *StFdPort;
 #define ST_FDPORT(x) ((StFdPort)(x))
 #define ST_FDPORT_FD(x) (ST_FDPORT(x)->fd)
+#define ST_FDPORT_BUFSIZE (1024*10)
+
+// the unread input in the buffer, for scanners reading it in place
+#define ST_FDPORT_AVAIL(x) (ST_FDPORT(x)->p == -1 ? 0 : (size_t)(ST_FDPORT(x)->size - ST_FDPORT(x)->p))
+#define ST_FDPORT_NEXT(x) (ST_FDPORT(x)->buf + ST_FDPORT(x)->p)
+
+// output buffering modes of ports
+enum { ST_BUFFER_NONE, ST_BUFFER_LINE, ST_BUFFER_FULL };
 
 // Tagged pointer structure
 //
@@ -199,6 +223,7 @@ typedef struct StFdPortRec *StFdPort;
 // singleton  __01010     False
 // singleton  __01110     Unbound
 // singleton  __10010     Eof
+// singleton  __10110     MultipleValues
 
 #define ST_TAG_BITS     2
 #define ST_TAG_MASK     0b11
@@ -212,6 +237,9 @@ typedef struct StFdPortRec *StFdPort;
 #define Unbound ST_OBJECT(0b01110)
 #define Eof     ST_OBJECT(0b10010)
 
+// returned in place of the values themselves, which are kept by the VM
+#define MultipleValues ST_OBJECT(0b10110)
+
 void St_Error(const char *fmt, ...) __attribute__((noreturn));
 
 #define St_Malloc GC_MALLOC
@@ -237,7 +265,7 @@ void *St_Alloc2(int type, size_t size);
 #define ST_SUBRP(obj)       ST_TAGP(obj, TSUBR)
 #define ST_LAMBDAP(obj)     ST_TAGP(obj, TLAMBDA)
 #define ST_MACROP(obj)      ST_TAGP(obj, TMACRO)
-#define ST_PROCEDUREP(obj)  (ST_SUBRP(obj) || ST_LAMBDAP(obj))
+#define ST_PROCEDUREP(obj)  (ST_SUBRP(obj) || ST_LAMBDAP(obj) || St_ParameterP(obj))
 #define ST_FDPORTP(obj)     ST_TAGP(obj, TFDPORT)
 #define ST_EXTERNALP(obj)   ST_TAGP(obj, TEXTERNAL)
 
@@ -373,6 +401,7 @@ bool St_VectorEqualP(StObject v1, StObject v2);
 
 StObject St_MakeBytevector(int size, int byte);
 StObject St_MakeBytevectorFromList(StObject bytes);
+StObject St_MakeBytevectorFromFile(const char *path);
 size_t St_BytevectorLength(StObject bytevector);
 uint8_t St_BytevectorU8Ref(StObject bytevector, int k);
 void St_BytevectorU8Set(StObject bytevector, int k, uint8_t byte);
@@ -391,6 +420,27 @@ StObject St_DVectorData(StObject vector);
 int St_DVectorCapacity(StObject vector);
 int St_DVectorPush(StObject vector, StObject obj);
 
+// Hashtable (complex type, eqv keys)
+
+StObject St_MakeHashtable(int capa);
+StObject St_HashtableRef(StObject table, StObject key, StObject fallback);
+void St_HashtableSet(StObject table, StObject key, StObject value);
+int St_HashtableCount(StObject table);
+
+// Region (short-lived allocation released in bulk)
+
+typedef struct StRegionChunkRec *StRegionChunk;
+typedef struct
+{
+    StRegionChunk chunk;
+    size_t used;
+} StRegionMark;
+
+void *St_RegionAlloc(size_t size);
+StRegionMark St_RegionMark(void);
+void St_RegionRelease(StRegionMark mark);
+StObject St_RegionCons(StObject car, StObject cdr);
+
 // Module
 
 extern StObject GlobalModule;
@@ -400,6 +450,10 @@ int St_ModuleFindOrInitialize(StObject module, StObject sym, StObject init);
 void St_ModulePush(StObject module, StObject sym, StObject value);
 void St_ModuleSet(StObject module, int idx, StObject val);
 StObject St_ModuleRef(StObject module, int idx);
+bool St_ModuleConstantP(StObject module, int idx);
+void St_ModuleAddDependent(StObject module, int idx, StObject insn, StObject deopt);
+StObject St_ModuleInfo(StObject module, int idx);
+void St_ModuleSetInfo(StObject module, int idx, StObject info);
 StObject St_ModuleSymbols(StObject module);
 void St_InitModule(void);
 
@@ -425,6 +479,13 @@ void St_InitSrfi60(void);
 
 StObject St_MakeFdPort(int fd, bool need_to_close);
 StObject St_OpenInputPort(const char *path);
+StObject St_OpenMappedInputPort(const char *path);
+StObject St_OpenInputMemoryPort(StObject object, uint8_t *data, size_t len);
+StObject St_OpenInputString(StObject string);
+StObject St_OpenInputBytevector(StObject bytevector);
+StObject St_OpenOutputMemoryPort(void);
+StObject St_GetOutputString(StObject port);
+StObject St_GetOutputBytevector(StObject port);
 StObject St_OpenOutputPort(const char *path);
 //StObject St_Read(StObject port);
 StObject St_ReadChar(StObject port);
@@ -440,11 +501,17 @@ void St_WriteBuffer(const char *buf, size_t len, StObject port);
 void St_WriteCString(const char *str, StObject port);
 void St_WriteU8(uint8_t byte, StObject port);
 void St_ClosePort(StObject port);
+void St_FlushPort(StObject port);
+void St_FlushAllPorts(void);
+bool St_PortBufferedP(StObject port);
+bool St_PortFill(StObject port);
+void St_PortConsume(StObject port, size_t n);
+bool St_PortClosedP(StObject port);
 //void St_CloseReadPort(StObject port);
 //void St_CloseWritePort(StObject port);
 
-//StObject St_ReadBytevector(int k, StObject port);
-//int St_ReadBytevectorX(StObject bytevector, StObject port, int start, int end);
+StObject St_ReadBytevector(int k, StObject port);
+int St_ReadBytevectorX(StObject bytevector, StObject port, int start, int end);
 extern StObject St_StandardInputPort;
 extern StObject St_StandardOutputPort;
 extern StObject St_StandardErrorPort;
@@ -453,6 +520,14 @@ extern StObject St_CurrentOutputPort;
 extern StObject St_CurrentErrorPort;
 void St_InitPort(void);
 
+// io_uring backend of file ports (ST_USE_IO_URING)
+
+bool St_UringAttach(StObject port, bool output);
+ssize_t St_UringRead(StObject port);
+void St_UringWrite(StObject port, const char *buf, size_t len);
+void St_UringFlush(StObject port);
+void St_UringDetach(StObject port);
+
 // System
 
 extern StObject St_CurrentExecScriptName; // filename or "-" (stdin)
@@ -460,7 +535,7 @@ StObject St_CommandLine(void);
 StObject St_GetEnvironment(StObject name);
 StObject St_GetEnvironments(void);
 
-// returns pair of ports: (in . out)
+// returns two values: input port and output port
 StObject St_SysPipe(void);
 int St_SysFork(void);
 void St_SysPause(void);
@@ -473,6 +548,7 @@ void St_InitSystem(int argc, char** argv);
 
 void St_AddSyntax(StObject module, const char *key, StSyntaxFunction syntax);
 void St_AddSubr(StObject module, const char *key, StSubrFunction subr);
+StObject St_MakeSubr(const char *name, StSubrFunction subr);
 
 void St_InitPrimitives(void);
 void St_InitSyntax(void);
@@ -482,6 +558,13 @@ void St_InitVm(void);
 
 StObject St_Parse(StObject module, StObject expr);
 StObject St_Read(StObject port);
+StObject St_MakeIncrementalReader(void);
+void St_ReaderFeed(StObject reader, const uint8_t *buf, size_t len);
+void St_ReaderFeedEof(StObject reader);
+StObject St_ReaderRead(StObject reader);
+bool St_NeedMoreP(StObject obj);
+bool St_DatumReadyP(const uint8_t *buf, size_t len);
+void St_InitReader(void);
 
 // Printer
 
@@ -493,6 +576,57 @@ void St_Print(StObject obj, StObject port);
 extern StObject St_DebugVM; // if true vm prints internal state.
 StObject St_Eval_VM(StObject module, StObject obj);
 StObject St__Eval_INSN(StObject module, StObject insn);
+StObject St_CaseLambdaClause(StObject proc, int argc);
+StObject St_Values(StCallInfo *cinfo);
+StObject St_Values2(StObject v1, StObject v2);
+StObject St_SingleValue(StObject obj);
+
+// negative for no limit
+typedef struct StEvalLimits
+{
+    long fuel;       // calls
+    long timeout_ms;
+    long max_heap;   // bytes allocated
+} StEvalLimits;
+
+StObject St_EvalWithLimits(StObject module, StObject expr, StEvalLimits *limits);
+
+// Threads
+
+void St_WaitReadable(int fd);
+bool St_ThreadsWaitableP(void);
+void St_InitThread(void);
+
+// Event loop
+
+void St_CancelPortEvents(StObject port);
+void St_InitEvent(void);
+
+// Exceptions
+
+void St_Raise(StObject obj, bool continuable) __attribute__((noreturn));
+void St_ReportUncaught(StObject obj) __attribute__((noreturn));
+StObject St_MakeErrorObject(StObject message, StObject irritants);
+bool St_ErrorObjectP(StObject obj);
+StObject St_ErrorObjectMessage(StObject obj);
+StObject St_ErrorObjectIrritants(StObject obj);
+void St_InitError(void);
+
+// Parameters and dynamic-wind
+
+StObject St_MakeParameter(StObject value, StObject converter);
+StObject St_MakeParameterAt(StObject *location, StObject converter);
+bool St_ParameterP(StObject obj);
+StObject St_ParameterRef(StObject param);
+void St_ParameterSet(StObject param, StObject value);
+StObject St_ParameterConvert(StObject param, StObject value);
+void St_InitParameter(void);
+
+// Syntax rules
+
+StObject St_MakeSyntaxRules(StObject spec);
+bool St_SyntaxRulesP(StObject obj);
+StObject St_SyntaxRulesExpand(StObject rules, StObject form);
 
 // Compiler
 
@@ -87,8 +87,13 @@ int main(int argc, char** argv)
     St_InitPort();
     St_InitSystem(argc, argv);
     St_InitPrimitives();
+    St_InitError();
+    St_InitParameter();
     St_InitSyntax();
     St_InitVm();
+    St_InitThread();
+    St_InitEvent();
+    St_InitReader();
 
     St_InitSrfi60();
 
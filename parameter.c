@@ -0,0 +1,127 @@
+#include "lisp.h"
+#include "subr.h"
+
+// Parameter objects
+//
+// A parameter keeps its innermost binding in a single location, so
+// looking it up is O(1). parameterize swaps the bound value into the
+// location on entry and back on exit (shallow binding), and the vm swaps
+// it again whenever a continuation or an escape crosses the parameterize.
+//
+// The location of the current ports is the C variable itself so that the
+// runtime reading St_CurrentOutputPort sees parameterized ports.
+
+struct StParameterRec
+{
+    ST_EXTERNAL_OBJECT_HEADER;
+    StObject *location;
+    StObject value;
+    StObject converter;
+};
+typedef struct StParameterRec *StParameter;
+#define ST_PARAMETER(x) ((StParameter)(x))
+
+static void display(StObject obj __attribute__((unused)), StObject port)
+{
+    St_WriteCString("#<parameter>", port);
+}
+
+static bool equalp(StObject lhs, StObject rhs)
+{
+    return lhs == rhs;
+}
+
+static StExternalTypeInfo ParameterTypeInfo = (StExternalTypeInfo) { "<parameter>", display, equalp };
+
+static StObject make_parameter(StObject *location, StObject converter)
+{
+    StParameter p = St_Alloc2(TEXTERNAL, sizeof(struct StParameterRec));
+
+    p->type_info = &ParameterTypeInfo;
+    p->location = location == NULL ? &p->value : location;
+    p->value = Nil;
+    p->converter = converter;
+
+    return (StObject)p;
+}
+
+StObject St_MakeParameter(StObject value, StObject converter)
+{
+    StObject p = make_parameter(NULL, converter);
+
+    St_ParameterSet(p, value);
+
+    return p;
+}
+
+// makes a parameter bound at a C variable, which is initialized already
+StObject St_MakeParameterAt(StObject *location, StObject converter)
+{
+    return make_parameter(location, converter);
+}
+
+bool St_ParameterP(StObject obj)
+{
+    return ST_EXTERNALP(obj) && ST_EXTERNAL_TYPE_INFO(obj) == &ParameterTypeInfo;
+}
+
+StObject St_ParameterRef(StObject param)
+{
+    return *ST_PARAMETER(param)->location;
+}
+
+void St_ParameterSet(StObject param, StObject value)
+{
+    *ST_PARAMETER(param)->location = value;
+}
+
+StObject St_ParameterConvert(StObject param, StObject value)
+{
+    StObject converter = ST_PARAMETER(param)->converter;
+
+    if (ST_FALSEP(converter))
+    {
+        return value;
+    }
+
+    StObject v = St_MakeVector(1);
+    St_VectorSet(v, 0, value);
+
+    return St_SingleValue(St_Apply(converter, &(StCallInfo){ ST_VECTOR(v), 1, 1 }));
+}
+
+static StObject subr_make_parameter(StCallInfo *cinfo)
+{
+    if (cinfo->count < 1 || cinfo->count > 2)
+    {
+        St_Error("make-parameter: wrong number of arguments");
+    }
+
+    ARG(value, 0);
+    StObject converter = cinfo->count == 2 ? St_Arg(cinfo, 1) : False;
+
+    if (!ST_FALSEP(converter) && !ST_PROCEDUREP(converter))
+    {
+        St_Error("make-parameter: procedure required");
+    }
+
+    StObject p = make_parameter(NULL, converter);
+    St_ParameterSet(p, St_ParameterConvert(p, value));
+
+    return p;
+}
+
+static StObject subr_parameterp(StCallInfo *cinfo)
+{
+    ST_ARGS1("parameter?", cinfo, obj);
+
+    return St_ParameterP(obj) ? True : False;
+}
+
+void St_InitParameter(void)
+{
+    StObject m = GlobalModule;
+
+    St_AddSubr(m, "make-parameter", subr_make_parameter);
+    St_AddSubr(m, "parameter?", subr_parameterp);
+}
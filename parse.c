@@ -1,47 +1,238 @@
 #include <ctype.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "lisp.h"
+#include "subr.h"
+
+// The reader works on the bytes in the port buffer: runs of whitespace,
+// of string contents and of symbol characters are scanned in place and
+// copied out at once, with SSE2 for the first two where it is available.
+// Tokens are collected in buffers which grow as needed.
 
 static StObject read_list(StObject port, bool allow_dot);
 static StObject read_quote(StObject port);
 static StObject read_integer(StObject port, int first_digit);
 static StObject read_hash(StObject port);
 static void read_comment(StObject port);
-static StObject read_symbol(StObject port, StObject first_char);
+static StObject read_symbol(StObject port, int first_char);
 static StObject read_string(StObject port);
 
-#define SYMBOL_LENGTH 50
-#define STRING_LENGTH 5000
+#define END_OF_INPUT (-1)
 
-#define peek St_PeekChar
+// next byte without reading it, or END_OF_INPUT
+static int peek(StObject port)
+{
+    if (!St_PortFill(port))
+    {
+        return END_OF_INPUT;
+    }
 
-#define getc(p) St_ReadChar(p)
-#define isspace_s(c) (!ST_EOFP(c) && isspace(ST_INT_VALUE(c)))
-#define isdigit_s(c) (!ST_EOFP(c) && isdigit(ST_INT_VALUE(c)))
-#define iscntrl_s(c) (!ST_EOFP(c) && iscntrl(ST_INT_VALUE(c)))
+    return *ST_FDPORT_NEXT(port);
+}
 
-static void skip_space(StObject port)
+static int read_byte(StObject port)
+{
+    int c = peek(port);
+
+    if (c != END_OF_INPUT)
+    {
+        St_PortConsume(port, 1);
+    }
+
+    return c;
+}
+
+#define getc(p) read_byte(p)
+
+#define isspace_s(c) ((c) != END_OF_INPUT && isspace(c))
+#define isdigit_s(c) ((c) != END_OF_INPUT && isdigit(c))
+
+// Token buffer
+
+#define TOKEN_INITIAL_SIZE 128
+
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t capacity;
+    char initial[TOKEN_INITIAL_SIZE];
+} Token;
+
+static void token_init(Token *t)
+{
+    t->data = t->initial;
+    t->len = 0;
+    t->capacity = TOKEN_INITIAL_SIZE;
+}
+
+static void token_append(Token *t, const void *buf, size_t len)
+{
+    if (t->len + len > t->capacity)
+    {
+        size_t capacity = t->capacity * 2;
+        while (capacity < t->len + len)
+        {
+            capacity *= 2;
+        }
+
+        char *data = St_Malloc(capacity);
+        memcpy(data, t->data, t->len);
+        t->data = data;
+        t->capacity = capacity;
+    }
+
+    memcpy(t->data + t->len, buf, len);
+    t->len += len;
+}
+
+static void token_push(Token *t, char c)
+{
+    token_append(t, &c, 1);
+}
+
+// Scanners
+//
+// Each returns the length of the leading run of bytes in p[0, n) which
+// the token continues over.
+
+static bool space_byte(uint8_t c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static size_t scan_space(const uint8_t *p, size_t n)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t' - 1);
+    const __m128i cr = _mm_set1_epi8('\r' + 1);
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        // '\t' to '\r' are compared as signed bytes, which bytes >= 0x80 are below
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                  _mm_and_si128(_mm_cmpgt_epi8(v, tab), _mm_cmplt_epi8(v, cr)));
+        unsigned mask = ~_mm_movemask_epi8(ws) & 0xffff;
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    while (i < n && space_byte(p[i]))
+    {
+        i++;
+    }
+
+    return i;
+}
+
+// up to the closing quote or a backslash
+static size_t scan_string(const uint8_t *p, size_t n)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                                       _mm_cmpeq_epi8(v, backslash)));
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    while (i < n && p[i] != '"' && p[i] != '\\')
+    {
+        i++;
+    }
+
+    return i;
+}
+
+static bool word_char(int c)
+{
+    if (c == END_OF_INPUT)
+    {
+        return false;
+    }
+    if (isspace(c) || iscntrl(c))
+    {
+        return false;
+    }
+    if (c == '(' || c == ')' || c == '\'' || c == '#' || c == ';')
+    {
+        return false;
+    }
+
+    return true; // TODO: more strict
+}
+
+static size_t scan_word(const uint8_t *p, size_t n)
+{
+    size_t i = 0;
+
+    while (i < n && word_char(p[i]))
+    {
+        i++;
+    }
+
+    return i;
+}
+
+// Copies the run the scanner accepts into the token, across refills of
+// the buffer. A NULL token just skips the run.
+static void read_run(StObject port, size_t (*scan)(const uint8_t *, size_t), Token *t)
 {
-    while (isspace_s(peek(port))) {
-        getc(port);
+    while (St_PortFill(port)) {
+        size_t avail = ST_FDPORT_AVAIL(port);
+        size_t n = scan(ST_FDPORT_NEXT(port), avail);
+
+        if (t != NULL)
+        {
+            token_append(t, ST_FDPORT_NEXT(port), n);
+        }
+        St_PortConsume(port, n);
+
+        if (n < avail)
+        {
+            return;
+        }
     }
 }
 
+static void skip_space(StObject port)
+{
+    read_run(port, scan_space, NULL);
+}
+
 static StObject read_expr(StObject port)
 {
     skip_space(port);
 
-    StObject c = getc(port);
+    int c = getc(port);
 
-    if (ST_EOFP(c))
+    if (c == END_OF_INPUT)
     {
         return Eof;
     }
 
-    switch (ST_INT_VALUE(c)) {
+    switch (c) {
     case '(':
-        if (peek(port) == St_Integer(')'))
+        if (peek(port) == ')')
         {
             getc(port);
             return Nil;
@@ -51,7 +242,7 @@ static StObject read_expr(StObject port)
         return read_quote(port);
     case '0': case '1': case '2': case '3': case '4':
     case '5': case '6': case '7': case '8': case '9':
-        return read_integer(port, ST_INT_VALUE(c) - '0');
+        return read_integer(port, c - '0');
     case '#':
         return read_hash(port);
     case ';':
@@ -80,15 +271,14 @@ static StObject read_list(StObject port, bool allow_dot)
     while (true) {
         skip_space(port);
 
-        StObject c = peek(port);
+        int c = peek(port);
 
-        if (ST_EOFP(c))
+        if (c == END_OF_INPUT)
         {
-            getc(port);
             St_Error("read: EOF in list");
         }
 
-        if (ST_INT_VALUE(c) == ')')
+        if (c == ')')
         {
             if (is_next_last)
             {
@@ -160,8 +350,7 @@ static StObject read_integer(StObject port, int first_digit)
     int value = first_digit;
 
     while (isdigit_s(peek(port))) {
-        StObject c = getc(port);
-        value = value * 10 + ST_INT_VALUE(c) - '0';
+        value = value * 10 + getc(port) - '0';
     }
 
     return St_Integer(value);
@@ -170,14 +359,14 @@ static StObject read_integer(StObject port, int first_digit)
 static StObject read_bytevector(StObject port)
 {
     skip_space(port);
-    StObject c = getc(port);
+    int c = getc(port);
 
-    if (ST_EOFP(c))
+    if (c == END_OF_INPUT)
     {
         St_Error("read: eof in bytevector");
     }
 
-    if (ST_INT_VALUE(c) == ')')
+    if (c == ')')
     {
         return Nil;
     }
@@ -187,7 +376,7 @@ static StObject read_bytevector(StObject port)
         St_Error("read: unexpected in bytevector");
     }
 
-    StObject i = read_integer(port, ST_INT_VALUE(c) - '0');
+    StObject i = read_integer(port, c - '0');
 
     return St_Cons(i, read_bytevector(port));
 }
@@ -196,29 +385,29 @@ static StObject read_hash(StObject port)
 {
     skip_space(port);
 
-    StObject c = getc(port);
+    int c = getc(port);
 
-    if (c == St_Integer('t'))
+    if (c == 't')
     {
         return True;
     }
 
-    if (c == St_Integer('f'))
+    if (c == 'f')
     {
         return False;
     }
 
-    if (c == St_Integer('u'))
+    if (c == 'u')
     {
-        StObject d = getc(port);
-        StObject e = getc(port);
-        if (d == St_Integer('8') && e == St_Integer('('))
+        int d = getc(port);
+        int e = getc(port);
+        if (d == '8' && e == '(')
         {
             return St_MakeBytevectorFromList(read_bytevector(port));
         }
     }
 
-    if (c == St_Integer('('))
+    if (c == '(')
     {
         StObject list = read_list(port, false);
         return St_MakeVectorFromList(list);
@@ -229,117 +418,502 @@ static StObject read_hash(StObject port)
 
 static void read_comment(StObject port)
 {
-    StObject c;
+    while (St_PortFill(port)) {
+        size_t avail = ST_FDPORT_AVAIL(port);
+        uint8_t *newline = memchr(ST_FDPORT_NEXT(port), '\n', avail);
+
+        if (newline != NULL)
+        {
+            St_PortConsume(port, newline - ST_FDPORT_NEXT(port) + 1);
+            return;
+        }
+        St_PortConsume(port, avail);
+    }
+}
+
+static StObject read_symbol(StObject port, int first_char)
+{
+    Token t;
+    token_init(&t);
+    token_push(&t, (char)first_char);
+
+    read_run(port, scan_word, &t);
+    token_push(&t, '\0');
+
+    return St_Intern(t.data);
+}
+
+static StObject read_string(StObject port)
+{
+    Token t;
+    token_init(&t);
+
+    while (true) {
+        read_run(port, scan_string, &t);
+
+        int c = getc(port);
+
+        if (c == END_OF_INPUT)
+        {
+            St_Error("read: unfinished string");
+        }
+
+        if (c == '"')
+        {
+            break;
+        }
 
-    do {
+        // a backslash
         c = getc(port);
-    } while (c != St_Integer('\n'));
+
+        switch (c) {
+        case END_OF_INPUT:
+            St_Error("read: unfinished string");
+        case '0':
+            token_push(&t, '\0');
+            break;
+        case 'a':
+            token_push(&t, '\a');
+            break;
+        case 'b':
+            token_push(&t, '\b');
+            break;
+        case 'f':
+            token_push(&t, '\f');
+            break;
+        case 'n':
+            token_push(&t, '\n');
+            break;
+        case 'r':
+            token_push(&t, '\r');
+            break;
+        case 'v':
+            token_push(&t, '\v');
+            break;
+        case '\\':
+            token_push(&t, '\\');
+            break;
+        case '"':
+            token_push(&t, '"');
+            break;
+        default:
+            St_Error("read: unsupported backslash literal: %c", (char)c);
+        }
+    }
+
+    return St_MakeString(t.len, t.data);
+}
+
+StObject St_Read(StObject port)
+{
+    return read_expr(port);
+}
+
+// Incremental reader
+//
+// Bytes are fed as they arrive, and reading returns a datum once all of
+// it has been fed, or the need-more object until then. A scanner keeps
+// the nesting depth and where it is inside a token between feeds, so
+// each byte is scanned once to find where the datum ends; the datum is
+// then read from the fed bytes with St_Read.
+
+enum {
+    SCAN_NORMAL,
+    SCAN_WORD,
+    SCAN_STRING,
+    SCAN_ESCAPE,
+    SCAN_COMMENT,
+    SCAN_HASH,
+    SCAN_HASH_U,
+    SCAN_HASH_U8,
+};
+
+struct StIncrementalReaderRec
+{
+    ST_EXTERNAL_OBJECT_HEADER;
+    uint8_t *buf;
+    size_t len;
+    size_t capacity;
+    size_t start; // of the next datum
+    size_t scan;  // of the next byte to scan
+    int mode;
+    int depth;
+    bool started; // whether the next datum has begun
+    bool eof;
+};
+typedef struct StIncrementalReaderRec *StIncrementalReader;
+#define ST_INCREMENTAL_READER(x) ((StIncrementalReader)(x))
+
+static void display(StObject obj __attribute__((unused)), StObject port)
+{
+    St_WriteCString("#<incremental-reader>", port);
 }
 
-static bool word_char(StObject c)
+static void display_need_more(StObject obj __attribute__((unused)), StObject port)
 {
-    if (ST_EOFP(c))
+    St_WriteCString("#<need-more>", port);
+}
+
+static bool equalp(StObject lhs, StObject rhs)
+{
+    return lhs == rhs;
+}
+
+static StExternalTypeInfo IncrementalReaderTypeInfo = (StExternalTypeInfo) { "<incremental-reader>", display, equalp };
+static StExternalTypeInfo NeedMoreTypeInfo = (StExternalTypeInfo) { "<need-more>", display_need_more, equalp };
+
+static StObject NeedMore = Nil;
+
+static bool incremental_readerp(StObject obj)
+{
+    return ST_EXTERNALP(obj) && ST_EXTERNAL_TYPE_INFO(obj) == &IncrementalReaderTypeInfo;
+}
+
+bool St_NeedMoreP(StObject obj)
+{
+    return obj == NeedMore;
+}
+
+StObject St_MakeIncrementalReader(void)
+{
+    StIncrementalReader r = St_Alloc2(TEXTERNAL, sizeof(struct StIncrementalReaderRec));
+
+    r->type_info = &IncrementalReaderTypeInfo;
+    r->buf = NULL;
+    r->len = 0;
+    r->capacity = 0;
+    r->start = 0;
+    r->scan = 0;
+    r->mode = SCAN_NORMAL;
+    r->depth = 0;
+    r->started = false;
+    r->eof = false;
+
+    return (StObject)r;
+}
+
+void St_ReaderFeed(StObject reader, const uint8_t *buf, size_t len)
+{
+    StIncrementalReader r = ST_INCREMENTAL_READER(reader);
+
+    if (r->eof)
     {
-        return false;
+        St_Error("reader-feed!: fed after the end of input");
     }
-    if (isspace_s(c) || iscntrl_s(c))
+
+    // the bytes already read are dropped
+    if (r->start > 0 && r->len + len > r->capacity)
     {
-        return false;
+        memmove(r->buf, r->buf + r->start, r->len - r->start);
+        r->len -= r->start;
+        r->scan -= r->start;
+        r->start = 0;
     }
-    int x = ST_INT_VALUE(c);
-    if (x == '(' || x == ')' || x == '\'' || x == '#' || x == ';')
+
+    if (r->len + len > r->capacity)
     {
-        return false;
+        size_t capacity = r->capacity == 0 ? 256 : r->capacity * 2;
+        while (capacity < r->len + len)
+        {
+            capacity *= 2;
+        }
+
+        uint8_t *p = St_Malloc(capacity);
+        if (r->len > 0)
+        {
+            memcpy(p, r->buf, r->len);
+        }
+        r->buf = p;
+        r->capacity = capacity;
     }
 
-    return true; // TODO: more strict
+    memcpy(r->buf + r->len, buf, len);
+    r->len += len;
 }
 
-static StObject read_symbol(StObject port, StObject first_char)
+void St_ReaderFeedEof(StObject reader)
 {
-    char buf[SYMBOL_LENGTH + 1] = { (char)ST_INT_VALUE(first_char) };
-    int p = 1;
+    ST_INCREMENTAL_READER(reader)->eof = true;
+}
 
-    // TODO: buffer overflow
-    while (word_char(peek(port))) {
-        buf[p++] = ST_INT_VALUE(getc(port));
-    }
+// Scans the bytes fed since the last call. Returns true when the bytes
+// from start to scan hold a whole datum. It only has to tell when St_Read
+// won't run out of input; St_Read reports malformed data.
+static bool scan_datum(StIncrementalReader r)
+{
+    while (r->scan < r->len) {
+        const uint8_t *p = r->buf + r->scan;
+        size_t n = r->len - r->scan;
+        int c = *p;
+
+        switch (r->mode) {
+        case SCAN_STRING: {
+            size_t k = scan_string(p, n);
+            r->scan += k;
+            if (k == n)
+            {
+                return false;
+            }
+
+            r->scan++;
+            if (p[k] == '\\')
+            {
+                r->mode = SCAN_ESCAPE;
+                continue;
+            }
 
-    buf[p] = 0;
+            r->mode = SCAN_NORMAL;
+            if (r->depth == 0)
+            {
+                return true;
+            }
+            continue;
+        }
 
-    return St_Intern(buf);
-}
+        case SCAN_ESCAPE:
+            r->scan++;
+            r->mode = SCAN_STRING;
+            continue;
 
-static StObject read_string(StObject port)
-{
-    char buf[STRING_LENGTH + 1];
-    bool backslash = false;
+        case SCAN_COMMENT: {
+            const uint8_t *newline = memchr(p, '\n', n);
+            if (newline == NULL)
+            {
+                r->scan = r->len;
+                return false;
+            }
 
-    int p = 0;
-    for (StObject c = getc(port); ; c = getc(port)) {
-        if (ST_EOFP(c))
-        {
-            St_Error("read: unfinished string");
+            r->scan += newline - p + 1;
+            r->mode = SCAN_NORMAL;
+            continue;
         }
 
-        if (backslash)
-        {
-            switch (ST_INT_VALUE(c)) {
-            case '0':
-                buf[p++] = '\0';
-                break;
-            case 'a':
-                buf[p++] = '\a';
-                break;
-            case 'b':
-                buf[p++] = '\b';
-                break;
-            case 'f':
-                buf[p++] = '\f';
-                break;
-            case 'n':
-                buf[p++] = '\n';
-                break;
-            case 'r':
-                buf[p++] = '\r';
-                break;
-            case 'v':
-                buf[p++] = '\v';
-                break;
-            case '\\':
-                buf[p++] = '\\';
-                break;
+        case SCAN_WORD: {
+            size_t k = scan_word(p, n);
+            r->scan += k;
+            if (k == n)
+            {
+                return false;
+            }
+
+            // the delimiter is scanned again as normal
+            r->mode = SCAN_NORMAL;
+            if (r->depth == 0)
+            {
+                return true;
+            }
+            continue;
+        }
+
+        case SCAN_HASH:
+            // St_Read skips spaces after '#'
+            if (space_byte(c))
+            {
+                r->scan++;
+                continue;
+            }
+
+            r->scan++;
+            if (c == 'u')
+            {
+                r->mode = SCAN_HASH_U;
+                continue;
+            }
+            break;
+
+        case SCAN_HASH_U:
+            r->scan++;
+            if (c == '8')
+            {
+                r->mode = SCAN_HASH_U8;
+                continue;
+            }
+            break;
+
+        case SCAN_HASH_U8:
+            r->scan++;
+            break;
+
+        default:
+            if (space_byte(c))
+            {
+                r->scan += scan_space(p, n);
+                continue;
+            }
+
+            r->scan++;
+
+            if (c == ';')
+            {
+                r->mode = SCAN_COMMENT;
+                continue;
+            }
+
+            r->started = true;
+
+            switch (c) {
             case '"':
-                buf[p++] = '"';
-                break;
+                r->mode = SCAN_STRING;
+                continue;
+            case '(':
+                r->depth++;
+                continue;
+            case ')':
+                if (r->depth > 0)
+                {
+                    r->depth--;
+                }
+                if (r->depth == 0)
+                {
+                    return true;
+                }
+                continue;
+            case '\'':
+                continue;
+            case '#':
+                r->mode = SCAN_HASH;
+                continue;
             default:
-
-                St_Error("read: unsupported backslash literal: %c", (char)ST_INT_VALUE(c));
+                r->mode = SCAN_WORD;
+                continue;
             }
-            backslash = false;
         }
-        else if (ST_INT_VALUE(c) == '"')
+
+        // the last byte of a hash literal: a vector or a bytevector opens
+        // a list, and anything else is complete
+        r->mode = SCAN_NORMAL;
+        if (c == '(')
         {
-            break;
+            r->depth++;
         }
-        else if (ST_INT_VALUE(c) == '\\')
+        else if (r->depth == 0)
         {
-            backslash = true;
+            return true;
         }
-        else
+    }
+
+    return false;
+}
+
+// whether buf holds a whole datum, so that reading it won't wait for
+// more input
+bool St_DatumReadyP(const uint8_t *buf, size_t len)
+{
+    struct StIncrementalReaderRec r;
+
+    r.buf = (uint8_t *)buf;
+    r.len = len;
+    r.scan = 0;
+    r.mode = SCAN_NORMAL;
+    r.depth = 0;
+    r.started = false;
+
+    return scan_datum(&r);
+}
+
+StObject St_ReaderRead(StObject reader)
+{
+    StIncrementalReader r = ST_INCREMENTAL_READER(reader);
+
+    if (!scan_datum(r))
+    {
+        if (!r->eof)
         {
-            buf[p++] = (char)ST_INT_VALUE(c);
-            if (p > STRING_LENGTH)
-            {
-                St_Error("read: too long string literal size");
-            }
+            return NeedMore;
+        }
+
+        // only spaces and comments are left
+        if (!r->started)
+        {
+            r->start = r->scan = r->len;
+            r->mode = SCAN_NORMAL;
+            return Eof;
         }
     }
 
-    return St_MakeString(p, buf);
+    size_t end = r->scan;
+    StObject port = St_OpenInputMemoryPort(reader, r->buf + r->start, end - r->start);
+
+    // a datum St_Read fails on is dropped
+    r->start = r->scan;
+    r->mode = SCAN_NORMAL;
+    r->depth = 0;
+    r->started = false;
+
+    StObject datum = St_Read(port);
+
+    // St_Read stops before the delimiter of "12abc" for example, so the
+    // rest is scanned again
+    r->start = r->scan = end - ST_FDPORT_AVAIL(port);
+
+    return datum;
+}
+
+static StObject subr_make_incremental_reader(StCallInfo *cinfo)
+{
+    ST_ARGS0("make-incremental-reader", cinfo);
+
+    return St_MakeIncrementalReader();
+}
+
+static StObject subr_reader_feed(StCallInfo *cinfo)
+{
+    ST_ARGS2("reader-feed!", cinfo, reader, data);
+
+    if (!incremental_readerp(reader))
+    {
+        St_Error("reader-feed!: incremental reader required");
+    }
+
+    if (ST_STRINGP(data))
+    {
+        St_ReaderFeed(reader, (const uint8_t *)ST_STRING_VALUE(data), ST_STRING_LENGTH(data));
+    }
+    else if (ST_BYTEVECTORP(data))
+    {
+        St_ReaderFeed(reader, ST_BYTEVECTOR_DATA(data), ST_BYTEVECTOR_LENGTH(data));
+    }
+    else if (ST_EOFP(data))
+    {
+        St_ReaderFeedEof(reader);
+    }
+    else
+    {
+        St_Error("reader-feed!: string, bytevector or eof required");
+    }
+
+    return Nil;
 }
 
-StObject St_Read(StObject port)
+static StObject subr_reader_read(StCallInfo *cinfo)
 {
-    return read_expr(port);
+    ST_ARGS1("reader-read", cinfo, reader);
+
+    if (!incremental_readerp(reader))
+    {
+        St_Error("reader-read: incremental reader required");
+    }
+
+    return St_ReaderRead(reader);
+}
+
+static StObject subr_need_morep(StCallInfo *cinfo)
+{
+    ST_ARGS1("need-more?", cinfo, obj);
+
+    return ST_BOOLEAN(St_NeedMoreP(obj));
+}
+
+void St_InitReader(void)
+{
+    StExternalObject o = St_Alloc2(TEXTERNAL, sizeof(struct StExternalObjectHeader));
+    o->type_info = &NeedMoreTypeInfo;
+    NeedMore = (StObject)o;
+
+    StObject m = GlobalModule;
+
+    St_AddSubr(m, "make-incremental-reader", subr_make_incremental_reader);
+    St_AddSubr(m, "reader-feed!", subr_reader_feed);
+    St_AddSubr(m, "reader-read", subr_reader_read);
+    St_AddSubr(m, "need-more?", subr_need_morep);
 }
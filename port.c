@@ -1,6 +1,10 @@
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <unistd.h>
@@ -12,10 +16,18 @@
 #define SIZE(o)          ST_FDPORT(o)->size
 #define P(o)             ST_FDPORT(o)->p
 #define BUF(o)           ST_FDPORT(o)->buf
+#define CAPACITY(o)      ST_FDPORT(o)->capacity
 #define NEED_TO_CLOSE(o) ST_FDPORT(o)->need_to_close
 #define EOFP(o)          ST_FDPORT(o)->eof
 #define CLOSEDP(o)       ST_FDPORT(o)->closed
-#define BUFSIZE          1024*10
+#define VTABLE(o)        ST_FDPORT(o)->vtable
+#define OBJECT(o)        ST_FDPORT(o)->object
+#define URING(o)         ST_FDPORT(o)->uring
+#define WBUF(o)          ST_FDPORT(o)->wbuf
+#define WSIZE(o)         ST_FDPORT(o)->wsize
+#define WCAPACITY(o)     ST_FDPORT(o)->wcapacity
+#define BUFFERING(o)     ST_FDPORT(o)->buffering
+#define BUFSIZE          ST_FDPORT_BUFSIZE
 
 /*
 
@@ -26,23 +38,115 @@
   SIZE(o)       |<---->|     SIZE of read data
   P(o)              ^        Pointer of next unread byte. When all bytes are read, P(o) points -1.
 
+  Ports other than the standard ones are non-blocking so that an event
+  loop can multiplex them; reads and writes wait with poll() when the fd
+  is not ready. The standard fds are shared with other processes and
+  left blocking.
+
+  Built with ST_USE_IO_URING, file ports do their reads and writes
+  through io_uring instead (uring.c).
+
+  A mapped port has the whole file mapped as its buffer, so the readers
+  scan the file itself and nothing is read into the buffer. A memory
+  port reads the data of a string or a bytevector in the same way and
+  appends its output to WBUF(o), which grows as needed.
+
+  Output is collected in WBUF(o) and written out when it is full (full
+  buffering), when a newline is written (line buffering) or right away
+  (no buffering). Files are fully buffered; stdout is line buffered on
+  a terminal and fully buffered otherwise; stderr is not buffered; other
+  fds such as pipes and sockets are line buffered. Buffered output is
+  also written out by flush-output-port, on close, before sys-fork and
+  at exit.
+
  */
 
+// The operations which differ between fd, mapped and memory ports
+struct StPortClassRec
+{
+    ssize_t (*fill)(StObject port); // reads into BUF(port); 0 at eof
+    void (*write)(StObject port, const char *buf, size_t len);
+    void (*flush)(StObject port);
+    void (*close)(StObject port);
+};
+
+static const struct StPortClassRec FdPortClass;
+static const struct StPortClassRec MappedPortClass;
+static const struct StPortClassRec MemoryPortClass;
+
+// ports which have an output buffer. The array is malloc'ed so that it
+// doesn't keep them alive; the finalizer removes a port from it.
+static StObject *Buffered;
+static int BufferedCount;
+static int BufferedCapacity;
+
+static void AddBuffered(StObject port)
+{
+    if (BufferedCount == BufferedCapacity)
+    {
+        BufferedCapacity = BufferedCapacity == 0 ? 16 : BufferedCapacity * 2;
+        Buffered = realloc(Buffered, BufferedCapacity * sizeof(StObject));
+        if (Buffered == NULL)
+        {
+            St_Error("out of memory");
+        }
+    }
+
+    Buffered[BufferedCount++] = port;
+}
+
+static void RemoveBuffered(StObject port)
+{
+    for (int i = 0; i < BufferedCount; i++) {
+        if (Buffered[i] == port)
+        {
+            Buffered[i] = Buffered[--BufferedCount];
+            return;
+        }
+    }
+}
+
 static void FinalizePort(GC_PTR obj, GC_PTR client_data __attribute__((unused)))
 {
     St_ClosePort(ST_OBJECT(obj));
+    RemoveBuffered(ST_OBJECT(obj));
 }
 
-StObject St_MakeFdPort(int fd, bool need_to_close)
+static StObject MakePort(const struct StPortClassRec *vtable, int fd, bool need_to_close)
 {
     StObject o = St_Alloc2(TFDPORT, sizeof(struct StFdPortRec));
+    VTABLE(o) = vtable;
     FD(o) = fd;
-    BUF(o) = St_Malloc(BUFSIZE);
+    BUF(o) = NULL;
     SIZE(o) = 0;
     P(o) = -1;
+    CAPACITY(o) = 0;
+    OBJECT(o) = Nil;
     NEED_TO_CLOSE(o) = need_to_close;
     EOFP(o) = false;
     CLOSEDP(o) = false;
+    WBUF(o) = NULL;
+    WSIZE(o) = 0;
+    WCAPACITY(o) = 0;
+    BUFFERING(o) = ST_BUFFER_NONE;
+    URING(o) = NULL;
+
+    return o;
+}
+
+StObject St_MakeFdPort(int fd, bool need_to_close)
+{
+    StObject o = MakePort(&FdPortClass, fd, need_to_close);
+    BUF(o) = St_Malloc(BUFSIZE);
+    CAPACITY(o) = BUFSIZE;
+    BUFFERING(o) = fd == 2 ? ST_BUFFER_NONE
+        : fd == 1 && !isatty(fd) ? ST_BUFFER_FULL
+        : ST_BUFFER_LINE;
+
+    if (fd > 2)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
 
     GC_register_finalizer(o, FinalizePort, NULL, NULL, NULL);
 
@@ -57,7 +161,89 @@ StObject St_OpenInputPort(const char *path)
         St_Error("open-input-port: open failed");
     }
 
-    return St_MakeFdPort(fd, true);
+    StObject port = St_MakeFdPort(fd, true);
+
+#ifdef ST_USE_IO_URING
+    St_UringAttach(port, false);
+#endif
+
+    return port;
+}
+
+// falls back to a port reading the file when it can't be mapped
+StObject St_OpenMappedInputPort(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        St_Error("open-input-port: open failed");
+    }
+
+    StObject port = St_MakeFdPort(fd, true);
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        return port;
+    }
+
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        return port;
+    }
+
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+    VTABLE(port) = &MappedPortClass;
+    BUF(port) = p;
+    SIZE(port) = st.st_size;
+    P(port) = 0;
+
+    return port;
+}
+
+// reads len bytes at data, which object keeps alive
+StObject St_OpenInputMemoryPort(StObject object, uint8_t *data, size_t len)
+{
+    StObject port = MakePort(&MemoryPortClass, -1, true);
+    OBJECT(port) = object;
+    BUF(port) = data;
+    SIZE(port) = len;
+    P(port) = len > 0 ? 0 : -1;
+
+    return port;
+}
+
+StObject St_OpenInputString(StObject string)
+{
+    return St_OpenInputMemoryPort(string, (uint8_t *)ST_STRING_VALUE(string), ST_STRING_LENGTH(string));
+}
+
+StObject St_OpenInputBytevector(StObject bytevector)
+{
+    return St_OpenInputMemoryPort(bytevector, ST_BYTEVECTOR_DATA(bytevector), ST_BYTEVECTOR_LENGTH(bytevector));
+}
+
+StObject St_OpenOutputMemoryPort(void)
+{
+    return MakePort(&MemoryPortClass, -1, true);
+}
+
+StObject St_GetOutputString(StObject port)
+{
+    return St_MakeString(WSIZE(port), WSIZE(port) == 0 ? "" : (const char *)WBUF(port));
+}
+
+StObject St_GetOutputBytevector(StObject port)
+{
+    StObject b = St_MakeBytevector(WSIZE(port), -1);
+    if (WSIZE(port) > 0)
+    {
+        memcpy(ST_BYTEVECTOR_DATA(b), WBUF(port), WSIZE(port));
+    }
+
+    return b;
 }
 
 StObject St_OpenOutputPort(const char *path)
@@ -68,20 +254,81 @@ StObject St_OpenOutputPort(const char *path)
         St_Error("open-output-port: open failed");
     }
 
-    return St_MakeFdPort(fd, true);
+    StObject port = St_MakeFdPort(fd, true);
+    BUFFERING(port) = ST_BUFFER_FULL;
+
+#ifdef ST_USE_IO_URING
+    St_UringAttach(port, true);
+#endif
+
+    return port;
 }
 
 #define IS_EMPTY_BUF(o) (P(o) == -1)
 #define BUF_REF(port) St_Integer(BUF(port)[P(port)])
 
-static bool FillBuffer(StObject port)
+// waits until a non-blocking fd is ready after EAGAIN
+static void WaitFd(int fd, short events, const char *error)
 {
-    ssize_t size = read(FD(port), BUF(port), BUFSIZE);
-    if (size == -1)
+    if (errno == EINTR)
     {
-        St_Error("read error");
+        return;
+    }
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        St_Error("%s", error);
+    }
+
+    struct pollfd p = { fd, events, 0 };
+    poll(&p, 1, -1);
+}
+
+static ssize_t ReadFd(StObject port, uint8_t *buf, size_t size)
+{
+    ssize_t r;
+
+    // a prompt is shown before waiting for its answer
+    if (FD(port) == 0)
+    {
+        St_FlushPort(St_StandardOutputPort);
+    }
+
+    while ((r = read(FD(port), buf, size)) == -1)
+    {
+        WaitFd(FD(port), POLLIN, "read error");
     }
 
+    return r;
+}
+
+static ssize_t FdFill(StObject port)
+{
+#ifdef ST_USE_IO_URING
+    if (URING(port) != NULL)
+    {
+        ssize_t size = St_UringRead(port);
+        if (size == -1)
+        {
+            St_Error("read error");
+        }
+        return size;
+    }
+#endif
+
+    return ReadFd(port, BUF(port), CAPACITY(port));
+}
+
+// mapped and memory ports have all of their input in the buffer already
+static ssize_t NoFill(StObject port __attribute__((unused)))
+{
+    return 0;
+}
+
+static bool FillBuffer(StObject port)
+{
+    ssize_t size = VTABLE(port)->fill(port);
+
     SIZE(port) = size;
     P(port) = 0;
 
@@ -94,17 +341,79 @@ static bool FillBuffer(StObject port)
     return true;
 }
 
-static StObject GetByteFromBuffer(StObject port)
+static void Consume(StObject port, size_t n)
 {
-    StObject c = BUF_REF(port);
-    P(port)++;
+    P(port) += n;
     if (SIZE(port) == P(port))
     {
         P(port) = -1;
     }
+}
+
+static StObject GetByteFromBuffer(StObject port)
+{
+    StObject c = BUF_REF(port);
+    Consume(port, 1);
     return c;
 }
 
+// reads up to len bytes into dst. Returns 0 only at eof.
+static size_t ReadBytes(StObject port, uint8_t *dst, size_t len)
+{
+    if (EOFP(port) || len == 0)
+    {
+        return 0;
+    }
+
+    if (IS_EMPTY_BUF(port))
+    {
+        // large reads go straight to the destination
+        if (len >= BUFSIZE && VTABLE(port) == &FdPortClass && URING(port) == NULL)
+        {
+            ssize_t n = ReadFd(port, dst, len);
+            if (n == 0)
+            {
+                EOFP(port) = true;
+            }
+            return n;
+        }
+
+        if (!FillBuffer(port))
+        {
+            return 0;
+        }
+    }
+
+    size_t n = SIZE(port) - P(port);
+    if (n > len)
+    {
+        n = len;
+    }
+
+    memcpy(dst, BUF(port) + P(port), n);
+    Consume(port, n);
+
+    return n;
+}
+
+// reads until len bytes are read or eof
+static size_t ReadFully(StObject port, uint8_t *dst, size_t len)
+{
+    size_t total = 0;
+
+    while (total < len)
+    {
+        size_t n = ReadBytes(port, dst + total, len - total);
+        if (n == 0)
+        {
+            break;
+        }
+        total += n;
+    }
+
+    return total;
+}
+
 StObject St_ReadChar(StObject port)
 {
     return St_ReadU8(port); // char is byte for now
@@ -117,26 +426,42 @@ StObject St_PeekChar(StObject port)
 
 StObject St_ReadLine(StObject port)
 {
-    StObject h = Nil, t = Nil;
+    char *line = NULL; // of a line spanning buffer refills
+    size_t len = 0, capacity = 0;
+
+    while (!EOFP(port) && (!IS_EMPTY_BUF(port) || FillBuffer(port))) {
+        char *start = (char *)BUF(port) + P(port);
+        size_t avail = SIZE(port) - P(port);
+        char *newline = memchr(start, '\n', avail);
+        size_t n = newline == NULL ? avail : (size_t)(newline - start);
 
-    while (true) {
-        StObject c = St_ReadChar(port);
-        if (ST_EOFP(c) || ST_INT_VALUE(c) == '\n')
+        Consume(port, newline == NULL ? n : n + 1);
+
+        if (line == NULL && newline != NULL)
         {
-            break;
+            return St_MakeString(n, start);
         }
-        ST_APPEND1(h, t, c);
-    }
 
-    int len = St_Length(h);
-    char buf[len];
-    int i = 0;
+        if (len + n > capacity)
+        {
+            capacity = (len + n) * 2;
+            char *p = St_Malloc(capacity);
+            if (len > 0)
+            {
+                memcpy(p, line, len);
+            }
+            line = p;
+        }
+        memcpy(line + len, start, n);
+        len += n;
 
-    ST_FOREACH(p, h) {
-        buf[i++] = ST_INT_VALUE(ST_CAR(p));
+        if (newline != NULL)
+        {
+            break;
+        }
     }
 
-    return St_MakeString(len, buf);
+    return St_MakeString(len, line == NULL ? "" : line);
 }
 
 bool St_CharReadyP(StObject port)
@@ -146,24 +471,71 @@ bool St_CharReadyP(StObject port)
 
 StObject St_ReadString(int k, StObject port)
 {
-    if (k <= 0)
+    if (k < 0)
     {
         St_Error("read-string: invalid length");
     }
 
-    char buf[k];
-    size_t len;
+    StObject s = St_MakeEmptyString(k); // char is byte for now
+    size_t len = ReadFully(port, (uint8_t *)ST_STRING_VALUE(s), k);
 
-    for (len = 0; len < (size_t)k; len++) {
-        StObject c = St_ReadChar(port);
-        if (ST_EOFP(c))
-        {
-            break;
-        }
-        buf[len] = ST_INT_VALUE(c);
+    if (len == 0 && k > 0)
+    {
+        return Eof;
+    }
+
+    if (len < (size_t)k)
+    {
+        return St_MakeString(len, ST_STRING_VALUE(s));
+    }
+
+    return s;
+}
+
+StObject St_ReadBytevector(int k, StObject port)
+{
+    if (k < 0)
+    {
+        St_Error("read-bytevector: invalid length");
+    }
+
+    StObject b = St_MakeBytevector(k, -1);
+    size_t len = ReadFully(port, ST_BYTEVECTOR_DATA(b), k);
+
+    if (len == 0 && k > 0)
+    {
+        return Eof;
+    }
+
+    if (len < (size_t)k)
+    {
+        return St_MakeBytevectorFrom(b, 0, len);
     }
 
-    return St_MakeString(len, buf);
+    return b;
+}
+
+// returns the number of bytes read, or -1 at eof
+int St_ReadBytevectorX(StObject bytevector, StObject port, int start, int end)
+{
+    if (start < 0 || end < start || (size_t)end > ST_BYTEVECTOR_LENGTH(bytevector))
+    {
+        St_Error("read-bytevector!: invalid range");
+    }
+
+    if (ST_BYTEVECTOR(bytevector)->read_only)
+    {
+        St_Error("read-bytevector!: bytevector is read-only");
+    }
+
+    size_t len = ReadFully(port, ST_BYTEVECTOR_DATA(bytevector) + start, end - start);
+
+    if (len == 0 && end > start)
+    {
+        return -1;
+    }
+
+    return len;
 }
 
 StObject St_ReadU8(StObject port)
@@ -202,82 +574,247 @@ StObject St_PeekU8(StObject port)
 
 bool St_U8ReadyP(StObject port)
 {
-    if (EOFP(port) || !IS_EMPTY_BUF(port))
+    if (EOFP(port) || !IS_EMPTY_BUF(port) || VTABLE(port) != &FdPortClass)
     {
         return true;
     }
 
-    fd_set fs;
-    FD_ZERO(&fs);
-    FD_SET(FD(port), &fs);
-    struct timeval tval = { 0, 0 };
+    struct pollfd p = { FD(port), POLLIN, 0 };
 
-    int r = select(FD(port) + 1, &fs, NULL, NULL, &tval);
+    int r = poll(&p, 1, 0);
 
     if (r == -1)
     {
-        St_Error("select error");
+        St_Error("poll error");
     }
 
     return r == 1;
 }
 
+bool St_PortBufferedP(StObject port)
+{
+    return !IS_EMPTY_BUF(port);
+}
+
+// makes sure the buffer has unread input; false at eof
+bool St_PortFill(StObject port)
+{
+    return !EOFP(port) && (!IS_EMPTY_BUF(port) || FillBuffer(port));
+}
+
+void St_PortConsume(StObject port, size_t n)
+{
+    Consume(port, n);
+}
+
+bool St_PortClosedP(StObject port)
+{
+    return CLOSEDP(port);
+}
+
 void St_Newline(StObject port)
 {
     St_WriteU8('\n', port);
 }
 
-void St_WriteBuffer(const char *buf, size_t len, StObject port)
+static void WriteOut(const char *buf, size_t len, StObject port)
 {
-    if (ST_FALSEP(port))
+#ifdef ST_USE_IO_URING
+    if (URING(port) != NULL)
     {
-        port = St_CurrentOutputPort;
+        St_UringWrite(port, buf, len);
+        return;
     }
+#endif
 
     size_t written = 0;
 
-    do {
+    while (written < len) {
         ssize_t l = write(FD(port), buf + written, len - written);
         if (l == -1)
         {
-            St_Error("write error");
+            WaitFd(FD(port), POLLOUT, "write error");
+            continue;
         }
         written += l;
-    } while (written < len);
+    }
 }
 
-void St_WriteCString(const char *str, StObject port)
+static void FdFlush(StObject port)
 {
-    size_t len = strlen(str);
-    St_WriteBuffer(str, len, port);
+    // cleared first so that a write error doesn't leave it to be written again
+    size_t size = WSIZE(port);
+    WSIZE(port) = 0;
+    WriteOut((const char *)WBUF(port), size, port);
+
+#ifdef ST_USE_IO_URING
+    if (URING(port) != NULL)
+    {
+        St_UringFlush(port);
+    }
+#endif
 }
 
-void St_WriteU8(uint8_t byte, StObject port)
+static void NoFlush(StObject port __attribute__((unused)))
+{
+}
+
+void St_FlushPort(StObject port)
 {
     if (ST_FALSEP(port))
     {
         port = St_CurrentOutputPort;
     }
 
-    ssize_t l = write(FD(port), &byte, 1);
+    if (!CLOSEDP(port))
+    {
+        VTABLE(port)->flush(port);
+    }
+}
+
+void St_FlushAllPorts(void)
+{
+    for (int i = 0; i < BufferedCount; i++) {
+        St_FlushPort(Buffered[i]);
+    }
+}
+
+static void FdWrite(StObject port, const char *buf, size_t len)
+{
+    if (BUFFERING(port) == ST_BUFFER_NONE)
+    {
+        // keeps messages after the output written before them
+        if (port == St_StandardErrorPort)
+        {
+            St_FlushPort(St_StandardOutputPort);
+        }
+        St_FlushPort(port);
+        WriteOut(buf, len, port);
+        return;
+    }
+
+    if (WBUF(port) == NULL)
+    {
+        WBUF(port) = St_Malloc(BUFSIZE);
+        AddBuffered(port);
+    }
+
+    if (WSIZE(port) + len > BUFSIZE)
+    {
+        St_FlushPort(port);
+
+        if (len >= BUFSIZE)
+        {
+            WriteOut(buf, len, port);
+            return;
+        }
+    }
+
+    memcpy(WBUF(port) + WSIZE(port), buf, len);
+    WSIZE(port) += len;
+
+    if (BUFFERING(port) == ST_BUFFER_LINE && memchr(buf, '\n', len) != NULL)
+    {
+        St_FlushPort(port);
+    }
+}
+
+static void MemoryWrite(StObject port, const char *buf, size_t len)
+{
+    if (WSIZE(port) + len > WCAPACITY(port))
+    {
+        size_t capacity = WCAPACITY(port) == 0 ? 256 : WCAPACITY(port);
+        while (capacity < WSIZE(port) + len)
+        {
+            capacity *= 2;
+        }
+
+        uint8_t *p = St_Malloc(capacity);
+        if (WSIZE(port) > 0)
+        {
+            memcpy(p, WBUF(port), WSIZE(port));
+        }
+        WBUF(port) = p;
+        WCAPACITY(port) = capacity;
+    }
+
+    memcpy(WBUF(port) + WSIZE(port), buf, len);
+    WSIZE(port) += len;
+}
 
-    if (l == -1)
+void St_WriteBuffer(const char *buf, size_t len, StObject port)
+{
+    if (ST_FALSEP(port))
     {
-        St_Error("write error");
+        port = St_CurrentOutputPort;
     }
+
+    VTABLE(port)->write(port, buf, len);
+}
+
+void St_WriteCString(const char *str, StObject port)
+{
+    size_t len = strlen(str);
+    St_WriteBuffer(str, len, port);
+}
+
+void St_WriteU8(uint8_t byte, StObject port)
+{
+    St_WriteBuffer((const char *)&byte, 1, port);
 }
 
 void St_ClosePort(StObject port)
 {
-    if (CLOSEDP(port) || !NEED_TO_CLOSE(port))
+    if (CLOSEDP(port))
     {
         return;
     }
 
-    close(FD(port));
+    St_FlushPort(port);
+
+    if (!NEED_TO_CLOSE(port))
+    {
+        return;
+    }
+
+    if (FD(port) >= 0)
+    {
+        St_CancelPortEvents(port);
+    }
+
+    VTABLE(port)->close(port);
     CLOSEDP(port) = true;
 }
 
+static void FdClose(StObject port)
+{
+    RemoveBuffered(port);
+
+#ifdef ST_USE_IO_URING
+    if (URING(port) != NULL)
+    {
+        St_UringDetach(port);
+    }
+#endif
+
+    close(FD(port));
+}
+
+static void MappedClose(StObject port)
+{
+    munmap(BUF(port), SIZE(port));
+    P(port) = -1;
+    FdClose(port);
+}
+
+static void NoClose(StObject port __attribute__((unused)))
+{
+}
+
+static const struct StPortClassRec FdPortClass = { FdFill, FdWrite, FdFlush, FdClose };
+static const struct StPortClassRec MappedPortClass = { NoFill, FdWrite, FdFlush, MappedClose };
+static const struct StPortClassRec MemoryPortClass = { NoFill, MemoryWrite, NoFlush, NoClose };
+
 #define PORT_PROC_BODY(name, body)                          \
     do {                                                    \
         StObject port = False;                              \
@@ -297,14 +834,203 @@ void St_ClosePort(StObject port)
         }                                                   \
     } while (0)
 
+// Appends what the fd has to the unread input, which is moved to the
+// front of the buffer, growing it as needed. Returns the number of bytes
+// read, 0 at eof or -1 when nothing is readable yet.
+static ssize_t AppendInput(StObject port)
+{
+    size_t avail = ST_FDPORT_AVAIL(port);
+
+    if (avail > 0 && P(port) > 0)
+    {
+        memmove(BUF(port), BUF(port) + P(port), avail);
+    }
+
+    if (avail == CAPACITY(port))
+    {
+        uint8_t *buf = St_Malloc(CAPACITY(port) * 2);
+        memcpy(buf, BUF(port), avail);
+        BUF(port) = buf;
+        CAPACITY(port) *= 2;
+    }
+
+    ssize_t r = read(FD(port), BUF(port) + avail, CAPACITY(port) - avail);
+
+    if (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    {
+        St_Error("read error");
+    }
+
+    SIZE(port) = avail + (r > 0 ? r : 0);
+    P(port) = SIZE(port) > 0 ? 0 : -1;
+
+    return r;
+}
+
+static bool BytesReadyP(StObject port, size_t n)
+{
+    return ST_FDPORT_AVAIL(port) >= n;
+}
+
+static bool LineReadyP(StObject port, size_t n __attribute__((unused)))
+{
+    return memchr(ST_FDPORT_NEXT(port), '\n', ST_FDPORT_AVAIL(port)) != NULL;
+}
+
+static bool DatumReadyP(StObject port, size_t n __attribute__((unused)))
+{
+    return St_DatumReadyP(ST_FDPORT_NEXT(port), ST_FDPORT_AVAIL(port));
+}
+
+// Lets other threads run until the port has the input a read needs, as
+// ready tells, so that the read doesn't block the process. A read which
+// has consumed part of the input can't be parked, so nothing is consumed
+// until all of it is in the buffer.
+static StObject wait_input(StObject port, bool (*ready)(StObject, size_t), ssize_t n)
+{
+    if (ST_FALSEP(port))
+    {
+        port = St_CurrentInputPort;
+    }
+
+    // the read reports an invalid length itself
+    if (n < 0 || EOFP(port) || VTABLE(port) != &FdPortClass || URING(port) != NULL || !St_ThreadsWaitableP())
+    {
+        return port;
+    }
+
+    while (!ready(port, n))
+    {
+        ssize_t r = AppendInput(port);
+        if (r == 0)
+        {
+            break; // the read sees the end of file
+        }
+        if (r == -1)
+        {
+            St_WaitReadable(FD(port));
+        }
+    }
+
+    return port;
+}
+
+static StObject subr_read(StCallInfo *cinfo)
+{
+    PORT_PROC_BODY("read", St_Read(wait_input(port, DatumReadyP, 0)));
+}
+
 static StObject subr_read_line(StCallInfo *cinfo)
 {
-    PORT_PROC_BODY("read-line", St_ReadLine(port));
+    PORT_PROC_BODY("read-line", St_ReadLine(wait_input(port, LineReadyP, 0)));
+}
+
+static StObject subr_read_string(StCallInfo *cinfo)
+{
+    StObject port = False;
+
+    switch (cinfo->count) {
+    case 2:
+        port = St_Arg(cinfo, 1);
+        if (!ST_FDPORTP(port))
+        {
+            St_Error("read-string: port required");
+        }
+
+    case 1: {
+        ARG(k, 0);
+        if (!ST_INTP(k))
+        {
+            St_Error("read-string: integer required");
+        }
+
+        return St_ReadString(ST_INT_VALUE(k), wait_input(port, BytesReadyP, ST_INT_VALUE(k)));
+    }
+    default:
+        St_Error("read-string: wrong number of arguments");
+    }
+}
+
+static StObject subr_read_bytevector(StCallInfo *cinfo)
+{
+    StObject port = False;
+
+    switch (cinfo->count) {
+    case 2:
+        port = St_Arg(cinfo, 1);
+        if (!ST_FDPORTP(port))
+        {
+            St_Error("read-bytevector: port required");
+        }
+
+    case 1: {
+        ARG(k, 0);
+        if (!ST_INTP(k))
+        {
+            St_Error("read-bytevector: integer required");
+        }
+
+        return St_ReadBytevector(ST_INT_VALUE(k), wait_input(port, BytesReadyP, ST_INT_VALUE(k)));
+    }
+    default:
+        St_Error("read-bytevector: wrong number of arguments");
+    }
+}
+
+static StObject subr_read_bytevectorx(StCallInfo *cinfo)
+{
+    StObject port = False;
+    int start = 0;
+    int end = -1;
+
+    switch (cinfo->count) {
+    case 4: {
+        ARG(oEnd, 3);
+        if (!ST_INTP(oEnd))
+        {
+            St_Error("read-bytevector!: integer required");
+        }
+        end = ST_INT_VALUE(oEnd);
+    }
+    case 3: {
+        ARG(oStart, 2);
+        if (!ST_INTP(oStart))
+        {
+            St_Error("read-bytevector!: integer required");
+        }
+        start = ST_INT_VALUE(oStart);
+    }
+    case 2:
+        port = St_Arg(cinfo, 1);
+        if (!ST_FDPORTP(port))
+        {
+            St_Error("read-bytevector!: port required");
+        }
+
+    case 1: {
+        ARG(b, 0);
+        if (!ST_BYTEVECTORP(b))
+        {
+            St_Error("read-bytevector!: bytevector required");
+        }
+
+        if (end == -1)
+        {
+            end = ST_BYTEVECTOR_LENGTH(b);
+        }
+
+        int n = St_ReadBytevectorX(b, wait_input(port, BytesReadyP, (size_t)end > ST_BYTEVECTOR_LENGTH(b) ? -1 : end - start), start, end);
+
+        return n == -1 ? Eof : St_Integer(n);
+    }
+    default:
+        St_Error("read-bytevector!: wrong number of arguments");
+    }
 }
 
 static StObject subr_read_char(StCallInfo *cinfo)
 {
-    PORT_PROC_BODY("read-char", St_ReadChar(port));
+    PORT_PROC_BODY("read-char", St_ReadChar(wait_input(port, BytesReadyP, 1)));
 }
 
 static StObject subr_write_u8(StCallInfo *cinfo)
@@ -337,12 +1063,12 @@ static StObject subr_write_u8(StCallInfo *cinfo)
 
 static StObject subr_read_u8(StCallInfo *cinfo)
 {
-    PORT_PROC_BODY("read-u8", St_ReadU8(port));
+    PORT_PROC_BODY("read-u8", St_ReadU8(wait_input(port, BytesReadyP, 1)));
 }
 
 static StObject subr_peek_u8(StCallInfo *cinfo)
 {
-    PORT_PROC_BODY("peek-u8", St_PeekU8(port));
+    PORT_PROC_BODY("peek-u8", St_PeekU8(wait_input(port, BytesReadyP, 1)));
 }
 
 static StObject subr_u8_readyp(StCallInfo *cinfo)
@@ -386,15 +1112,158 @@ static StObject subr_close_port(StCallInfo *cinfo)
     return Nil;
 }
 
+static StObject subr_flush_output_port(StCallInfo *cinfo)
+{
+    PORT_PROC_BODY("flush-output-port", (St_FlushPort(port), Nil));
+}
+
+static StObject buffering_symbol(int mode)
+{
+    switch (mode) {
+    case ST_BUFFER_NONE:
+        return St_Intern("none");
+    case ST_BUFFER_LINE:
+        return St_Intern("line");
+    default:
+        return St_Intern("full");
+    }
+}
+
+static StObject subr_port_buffering(StCallInfo *cinfo)
+{
+    ST_ARGS1("port-buffering", cinfo, port);
+
+    if (!ST_FDPORTP(port))
+    {
+        St_Error("port-buffering: port required");
+    }
+
+    return buffering_symbol(BUFFERING(port));
+}
+
+static StObject subr_set_port_buffering(StCallInfo *cinfo)
+{
+    ST_ARGS2("set-port-buffering!", cinfo, port, mode);
+
+    if (!ST_FDPORTP(port))
+    {
+        St_Error("set-port-buffering!: port required");
+    }
+
+    int m;
+    if (mode == St_Intern("none"))
+    {
+        m = ST_BUFFER_NONE;
+    }
+    else if (mode == St_Intern("line"))
+    {
+        m = ST_BUFFER_LINE;
+    }
+    else if (mode == St_Intern("full"))
+    {
+        m = ST_BUFFER_FULL;
+    }
+    else
+    {
+        St_Error("set-port-buffering!: none, line or full required");
+    }
+
+    St_FlushPort(port);
+    BUFFERING(port) = m;
+
+    return Nil;
+}
+
+static StObject subr_open_input_string(StCallInfo *cinfo)
+{
+    ST_ARGS1("open-input-string", cinfo, s);
+
+    if (!ST_STRINGP(s))
+    {
+        St_Error("open-input-string: string required");
+    }
+
+    return St_OpenInputString(s);
+}
+
+static StObject subr_open_input_bytevector(StCallInfo *cinfo)
+{
+    ST_ARGS1("open-input-bytevector", cinfo, b);
+
+    if (!ST_BYTEVECTORP(b))
+    {
+        St_Error("open-input-bytevector: bytevector required");
+    }
+
+    return St_OpenInputBytevector(b);
+}
+
+static StObject subr_open_output_string(StCallInfo *cinfo)
+{
+    ST_ARGS0("open-output-string", cinfo);
+
+    return St_OpenOutputMemoryPort();
+}
+
+static StObject subr_open_output_bytevector(StCallInfo *cinfo)
+{
+    ST_ARGS0("open-output-bytevector", cinfo);
+
+    return St_OpenOutputMemoryPort();
+}
+
+static StObject subr_get_output_string(StCallInfo *cinfo)
+{
+    ST_ARGS1("get-output-string", cinfo, port);
+
+    if (!ST_FDPORTP(port) || VTABLE(port) != &MemoryPortClass)
+    {
+        St_Error("get-output-string: memory port required");
+    }
+
+    return St_GetOutputString(port);
+}
+
+static StObject subr_get_output_bytevector(StCallInfo *cinfo)
+{
+    ST_ARGS1("get-output-bytevector", cinfo, port);
+
+    if (!ST_FDPORTP(port) || VTABLE(port) != &MemoryPortClass)
+    {
+        St_Error("get-output-bytevector: memory port required");
+    }
+
+    return St_GetOutputBytevector(port);
+}
+
+// (open-input-file path [:mmap bool])
 static StObject subr_open_input_file(StCallInfo *cinfo)
 {
-    ST_ARGS1("open-input-file", cinfo, path);
+    if (cinfo->count != 1 && cinfo->count != 3)
+    {
+        St_Error("open-input-file: wrong number of arguments");
+    }
+
+    ARG(path, 0);
 
     if (!ST_STRINGP(path))
     {
         St_Error("open-input-file: string required");
     }
 
+    if (cinfo->count == 3)
+    {
+        if (St_Arg(cinfo, 1) != St_Intern(":mmap"))
+        {
+            St_Error("open-input-file: unknown keyword");
+        }
+
+        if (ST_TRUTHYP(St_Arg(cinfo, 2)))
+        {
+            return St_OpenMappedInputPort(St_StringGetCString(path));
+        }
+    }
+
     return St_OpenInputPort(St_StringGetCString(path));
 }
 
@@ -424,9 +1293,15 @@ void St_InitPort(void)
     St_CurrentOutputPort = St_StandardOutputPort = St_MakeFdPort(1, false);
     St_CurrentErrorPort  = St_StandardErrorPort  = St_MakeFdPort(2, false);
 
+    atexit(St_FlushAllPorts);
+
     StObject m = GlobalModule;
 
+    St_AddSubr(m, "read", subr_read);
     St_AddSubr(m, "read-line", subr_read_line);
+    St_AddSubr(m, "read-string", subr_read_string);
+    St_AddSubr(m, "read-bytevector", subr_read_bytevector);
+    St_AddSubr(m, "read-bytevector!", subr_read_bytevectorx);
     St_AddSubr(m, "read-char", subr_read_char);
     St_AddSubr(m, "write-u8", subr_write_u8);
     St_AddSubr(m, "read-u8", subr_read_u8);
@@ -435,6 +1310,15 @@ void St_InitPort(void)
     St_AddSubr(m, "display", subr_display);
     St_AddSubr(m, "newline", subr_newline);
     St_AddSubr(m, "close-port", subr_close_port);
+    St_AddSubr(m, "flush-output-port", subr_flush_output_port);
+    St_AddSubr(m, "port-buffering", subr_port_buffering);
+    St_AddSubr(m, "set-port-buffering!", subr_set_port_buffering);
     St_AddSubr(m, "open-input-file", subr_open_input_file);
     St_AddSubr(m, "open-output-file", subr_open_output_file);
+    St_AddSubr(m, "open-input-string", subr_open_input_string);
+    St_AddSubr(m, "open-input-bytevector", subr_open_input_bytevector);
+    St_AddSubr(m, "open-output-string", subr_open_output_string);
+    St_AddSubr(m, "open-output-bytevector", subr_open_output_bytevector);
+    St_AddSubr(m, "get-output-string", subr_get_output_string);
+    St_AddSubr(m, "get-output-bytevector", subr_get_output_bytevector);
 }
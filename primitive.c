@@ -589,6 +589,47 @@ static StObject subr_eval_vm(StCallInfo *cinfo)
     return St_Eval_VM(GlobalModule, expr);
 }
 
+// (eval-with-limits expr [:fuel calls] [:timeout-ms ms] [:max-heap bytes])
+// an exceeded limit skips the after thunks of pending dynamic-winds
+static StObject subr_eval_with_limits(StCallInfo *cinfo)
+{
+    if (cinfo->count < 1 || cinfo->count % 2 != 1)
+    {
+        St_Error("eval-with-limits: wrong number of arguments");
+    }
+
+    StEvalLimits limits = { -1, -1, -1 };
+
+    for (int i = 1; i < cinfo->count; i += 2) {
+        ARG(key, i);
+        ARG(value, i + 1);
+
+        if (!ST_INTP(value) || ST_INT_VALUE(value) < 0)
+        {
+            St_Error("eval-with-limits: non-negative integer required");
+        }
+
+        if (key == St_Intern(":fuel"))
+        {
+            limits.fuel = ST_INT_VALUE(value);
+        }
+        else if (key == St_Intern(":timeout-ms"))
+        {
+            limits.timeout_ms = ST_INT_VALUE(value);
+        }
+        else if (key == St_Intern(":max-heap"))
+        {
+            limits.max_heap = ST_INT_VALUE(value);
+        }
+        else
+        {
+            St_Error("eval-with-limits: unknown keyword");
+        }
+    }
+
+    return St_EvalWithLimits(GlobalModule, St_Arg(cinfo, 0), &limits);
+}
+
 static StObject subr_set_memberp(StCallInfo *cinfo)
 {
     ST_ARGS2("set-member?", cinfo, obj, set);
@@ -730,6 +771,11 @@ static StObject subr_apply(StCallInfo *cinfo)
     return St_Apply(proc, &(StCallInfo){ ST_VECTOR(v), St_VectorLength(v), St_VectorLength(v) });
 }
 
+static StObject subr_values(StCallInfo *cinfo)
+{
+    return St_Values(cinfo);
+}
+
 static StObject subr_macroexpand(StCallInfo *cinfo)
 {
     ST_ARGS1("macroexpand", cinfo, expr);
@@ -992,39 +1038,29 @@ static StObject subr_bytevector_append(StCallInfo *cinfo)
     return St_BytevectorAppend(x);
 }
 
-static StObject current_x_port_impl(StCallInfo *cinfo, const char* name, StObject *port)
+static StObject subr_file_to_bytevector(StCallInfo *cinfo)
 {
-    switch (cinfo->count) {
-    case 1: {
-        ARG(np, 0);
-        if (!ST_FDPORTP(np))
-        {
-            St_Error("%s: port required", name);
-        }
-        StObject tmp = *port;
-        *port = np;
-        return tmp;
-    }
-    case 0:
-        return *port;
-    default:
-        St_Error("%s: wrong number of arguments", name);
+    ST_ARGS1("file->bytevector", cinfo, path);
+
+    if (!ST_STRINGP(path))
+    {
+        St_Error("file->bytevector: string required");
     }
-}
 
-static StObject subr_current_input_port(StCallInfo *cinfo)
-{
-    return current_x_port_impl(cinfo, "current-input-port", &St_CurrentInputPort);
+    return St_MakeBytevectorFromFile(St_StringGetCString(path));
 }
 
-static StObject subr_current_output_port(StCallInfo *cinfo)
+// converter of the current port parameters
+static StObject subr_check_port(StCallInfo *cinfo)
 {
-    return current_x_port_impl(cinfo, "current-output-port", &St_CurrentOutputPort);
-}
+    ST_ARGS1("current-port", cinfo, port);
 
-static StObject subr_current_error_port(StCallInfo *cinfo)
-{
-    return current_x_port_impl(cinfo, "current-error-port", &St_CurrentErrorPort);
+    if (!ST_FDPORTP(port))
+    {
+        St_Error("current-port: port required");
+    }
+
+    return port;
 }
 
 static StObject subr_to_expr(StCallInfo *cinfo)
@@ -1083,6 +1119,7 @@ void St_InitPrimitives(void)
     St_AddSubr(m, "vector-length", subr_vector_length);
     St_AddSubr(m, "compile", subr_compile);
     St_AddSubr(m, "eval-vm", subr_eval_vm);
+    St_AddSubr(m, "eval-with-limits", subr_eval_with_limits);
     St_AddSubr(m, "set-member?", subr_set_memberp);
     St_AddSubr(m, "set-cons", subr_set_cons);
     St_AddSubr(m, "set-union", subr_set_union);
@@ -1094,6 +1131,7 @@ void St_InitPrimitives(void)
     St_AddSubr(m, "string-append", subr_string_append);
     St_AddSubr(m, "string=?", subr_string_equalp);
     St_AddSubr(m, "apply", subr_apply);
+    St_AddSubr(m, "values", subr_values);
     St_AddSubr(m, "macroexpand", subr_macroexpand);
     St_AddSubr(m, "load", subr_load);
     St_AddSubr(m, "eof-object", subr_eof_object);
@@ -1111,8 +1149,11 @@ void St_InitPrimitives(void)
     St_AddSubr(m, "bytevector-copy", subr_bytevector_copy);
     St_AddSubr(m, "bytevector-copy!", subr_bytevector_copyx);
     St_AddSubr(m, "bytevector-append", subr_bytevector_append);
-    St_AddSubr(m, "current-input-port", subr_current_input_port);
-    St_AddSubr(m, "current-output-port", subr_current_output_port);
-    St_AddSubr(m, "current-error-port", subr_current_error_port);
+    St_AddSubr(m, "file->bytevector", subr_file_to_bytevector);
+
+    StObject check = St_MakeSubr("current-port", subr_check_port);
+    St_ModulePush(m, St_Intern("current-input-port"), St_MakeParameterAt(&St_CurrentInputPort, check));
+    St_ModulePush(m, St_Intern("current-output-port"), St_MakeParameterAt(&St_CurrentOutputPort, check));
+    St_ModulePush(m, St_Intern("current-error-port"), St_MakeParameterAt(&St_CurrentErrorPort, check));
     St_AddSubr(m, "to-expr", subr_to_expr);
 }
@@ -30,6 +30,7 @@ static void print(StObject obj, StObject port)
         CASE(False, "#f");
         CASE(Eof, "#<eof-object>");
         CASE(Unbound, "#<unbound>");
+        CASE(MultipleValues, "#<values>");
 
 #undef CASE
     }
@@ -136,6 +137,12 @@ static void print(StObject obj, StObject port)
     }
 
     case TFDPORT: {
+        if (ST_FDPORT_FD(obj) < 0)
+        {
+            St_WriteCString("#<port memory>", port);
+            break;
+        }
+
         St_WriteCString("#<port fd:", port);
         char buf[20];
         sprintf(buf, "%d", ST_FDPORT_FD(obj));
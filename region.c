@@ -0,0 +1,100 @@
+#include <string.h>
+
+#include "lisp.h"
+
+// Region allocator
+//
+// Short-lived data is bump-allocated from chunks and released all at once
+// back to a mark. Chunks are allocated with GC_MALLOC so that objects on
+// the GC heap referred only from the region stay alive, but allocating in
+// the region itself never triggers a collection. Released chunks are
+// cleared and kept for reuse.
+
+#define REGION_CHUNK_SIZE (64 * 1024)
+
+struct StRegionChunkRec
+{
+    struct StRegionChunkRec *prev;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+static StRegionChunk current = NULL;
+static StRegionChunk spare = NULL;
+
+static StRegionChunk new_chunk(size_t size)
+{
+    StRegionChunk *p = &spare;
+
+    for (; *p != NULL; p = &(*p)->prev) {
+        if ((*p)->size >= size)
+        {
+            StRegionChunk c = *p;
+            *p = c->prev;
+            return c;
+        }
+    }
+
+    if (size < REGION_CHUNK_SIZE)
+    {
+        size = REGION_CHUNK_SIZE;
+    }
+
+    StRegionChunk c = GC_MALLOC(sizeof(struct StRegionChunkRec) + size);
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+void *St_RegionAlloc(size_t size)
+{
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+    if (current == NULL || current->used + size > current->size)
+    {
+        StRegionChunk c = new_chunk(size);
+        c->prev = current;
+        current = c;
+    }
+
+    void *p = current->data + current->used;
+    current->used += size;
+    return p;
+}
+
+StRegionMark St_RegionMark(void)
+{
+    return (StRegionMark){ current, current == NULL ? 0 : current->used };
+}
+
+void St_RegionRelease(StRegionMark mark)
+{
+    while (current != mark.chunk)
+    {
+        StRegionChunk c = current;
+        current = c->prev;
+
+        memset(c->data, 0, c->used);
+        c->used = 0;
+        c->prev = spare;
+        spare = c;
+    }
+
+    if (current != NULL)
+    {
+        memset(current->data + mark.used, 0, current->used - mark.used);
+        current->used = mark.used;
+    }
+}
+
+StObject St_RegionCons(StObject car, StObject cdr)
+{
+    StObject cell = St_RegionAlloc(sizeof(struct StCellRec));
+
+    cell->type = TCELL;
+    ST_CAR_SET(cell, car);
+    ST_CDR_SET(cell, cdr);
+
+    return cell;
+}
@@ -22,10 +22,8 @@
 ;;                    (loop (- toread r) (+ nread r)))))
 ;;              ))))
 
-(let ((r (sys-pipe))
-      (test "hogehoge"))
-  (let ((in (car r))
-        (out (cdr r)))
+(let1 test "hogehoge"
+  (receive (in out) (sys-pipe)
     (let1 pid (sys-fork)
       (if (= pid 0)
         (begin
@@ -23,7 +23,7 @@ static void validate_bindings(StObject args)
     }
 }
 
-static StObject syntax_let(StObject module, StObject expr)
+static StObject syntax_let(StObject module __attribute__((unused)), StObject expr)
 {
     // (let <bindings> <body>)
     // <bindings> ::= ((sym <expr>)*)
@@ -50,12 +50,10 @@ static StObject syntax_let(StObject module, StObject expr)
     }
 
     StObject lambda = St_Cons(I("lambda"), St_Cons(syms, body));
-    StObject ret = St_Cons(lambda, vals);
-
-    return St_SyntaxExpand(module, ret);
+    return St_Cons(lambda, vals);
 }
 
-static StObject syntax_let1(StObject module, StObject expr)
+static StObject syntax_let1(StObject module __attribute__((unused)), StObject expr)
 {
     if (St_Length(expr) < 3)
     {
@@ -70,12 +68,10 @@ static StObject syntax_let1(StObject module, StObject expr)
     StObject sym = ST_CADR(expr);
     StObject val = ST_CADDR(expr);
     StObject body = ST_CDR(ST_CDDR(expr));
-    StObject ret = St_Cons(I("let"), St_Cons(ST_LIST1(ST_LIST2(sym, val)), body));
-
-    return St_SyntaxExpand(module, ret);
+    return St_Cons(I("let"), St_Cons(ST_LIST1(ST_LIST2(sym, val)), body));
 }
 
-static StObject syntax_letrec(StObject module, StObject expr)
+static StObject syntax_letrec(StObject module __attribute__((unused)), StObject expr)
 {
     // (letrec <bindings> <body>)
     // <bindings> ::= ((sym <expr>)*)
@@ -98,16 +94,16 @@ static StObject syntax_letrec(StObject module, StObject expr)
         StObject s = ST_CAAR(p);
         StObject e = ST_CAR(ST_CDAR(p));
 
-        ST_APPEND1(ds, t, ST_LIST3(I("define"), s, St_SyntaxExpand(module, e)));
+        ST_APPEND1(ds, t, ST_LIST3(I("define"), s, e));
     }
 
     return ST_LIST1(St_Cons(I("lambda"),
                             St_Cons(Nil,
                                     St_Cons(St_Cons(I("begin"), ds),
-                                            St_SyntaxExpand(module, body)))));
+                                            body))));
 }
 
-static StObject syntax_define(StObject module, StObject expr)
+static StObject syntax_define(StObject module __attribute__((unused)), StObject expr)
 {
     if (St_Length(expr) < 2)
     {
@@ -121,13 +117,10 @@ static StObject syntax_define(StObject module, StObject expr)
         StObject body = ST_CDDR(expr);
         StObject lambda = St_Cons(I("lambda"), St_Cons(vars, body));
 
-        StObject ret = St_Cons(I("define"),
-                               St_Cons(St_SyntaxExpand(module, sym),
-                                       ST_LIST1(St_SyntaxExpand(module, lambda))));
-        return ret;
+        return ST_LIST3(I("define"), sym, lambda);
     }
 
-    return St_Cons(ST_CAR(expr), St_SyntaxExpand(module, ST_CDR(expr)));
+    return expr;
 }
 
 static StObject cond_expand(StObject expr)
@@ -157,9 +150,9 @@ static StObject cond_expand(StObject expr)
     St_Error("cond: malformed cond clause");
 }
 
-static StObject syntax_cond(StObject module, StObject expr)
+static StObject syntax_cond(StObject module __attribute__((unused)), StObject expr)
 {
-    return St_SyntaxExpand(module, cond_expand(ST_CDR(expr)));
+    return cond_expand(ST_CDR(expr));
 }
 
 static StObject case_expand(StObject sym, StObject expr)
@@ -189,7 +182,63 @@ static StObject case_expand(StObject sym, StObject expr)
     St_Error("case: malformed case clause");
 }
 
-static StObject syntax_case(StObject module, StObject expr)
+// true if every datum is a fixnum, a character or a symbol
+static bool case_dispatchableP(StObject clauses)
+{
+    ST_FOREACH(p, clauses) {
+        StObject clause = ST_CAR(p);
+
+        if (!ST_PAIRP(clause))
+        {
+            return false;
+        }
+
+        if (ST_CAR(clause) == I("else"))
+        {
+            if (!ST_NULLP(ST_CDR(p)))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (!St_ListP(ST_CAR(clause)))
+        {
+            return false;
+        }
+
+        ST_FOREACH(q, ST_CAR(clause)) {
+            StObject d = ST_CAR(q);
+            if (!ST_INTP(d) && !ST_CHARP(d) && !ST_SYMBOLP(d))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// (---case--- key ('(datum ...) body ...) ... [(#t body ...)])
+//
+// Datums are quoted so that the compiler passes do not take them for
+// expressions. The compiler dispatches on them with a table.
+static StObject case_dispatch(StObject key, StObject clauses)
+{
+    StObject cs = Nil, t = Nil;
+
+    ST_FOREACH(p, clauses) {
+        StObject clause = ST_CAR(p);
+        StObject head = ST_CAR(clause) == I("else")
+            ? True
+            : ST_LIST2(I("quote"), ST_CAR(clause));
+
+        ST_APPEND1(cs, t, St_Cons(head, ST_CDR(clause)));
+    }
+
+    return St_Cons(I("---case---"), St_Cons(key, cs));
+}
+
+static StObject syntax_case(StObject module __attribute__((unused)), StObject expr)
 {
     int len = St_Length(expr);
     if (len < 3)
@@ -197,12 +246,717 @@ static StObject syntax_case(StObject module, StObject expr)
         St_Error("case: malformed case");
     }
 
+    if (case_dispatchableP(ST_CDDR(expr)))
+    {
+        return case_dispatch(ST_CADR(expr), ST_CDDR(expr));
+    }
+
     StObject sym = St_Gensym();
     StObject val = ST_CADR(expr);
     StObject body = ST_CDDR(expr);
-    StObject ret = ST_LIST4(I("let1"), sym, val, case_expand(sym, body));
+    return ST_LIST4(I("let1"), sym, val, case_expand(sym, body));
+}
+
+static StObject syntax_case_lambda(StObject module __attribute__((unused)), StObject expr)
+{
+    // (case-lambda (formals body ...) ...)
+    // =>
+    // (---case-lambda--- (lambda formals body ...) ...)
+
+    StObject clauses = Nil, tail = Nil;
+
+    if (!St_ListP(expr))
+    {
+        St_Error("case-lambda: malformed case-lambda");
+    }
+
+    ST_FOREACH(p, ST_CDR(expr)) {
+        StObject clause = ST_CAR(p);
+
+        if (!ST_PAIRP(clause) || !ST_PAIRP(ST_CDR(clause)))
+        {
+            St_Error("case-lambda: malformed clause");
+        }
+
+        ST_APPEND1(clauses, tail, St_Cons(I("lambda"), clause));
+    }
+
+    return St_Cons(I("---case-lambda---"), clauses);
+}
+
+static StObject syntax_define_optional(StObject module __attribute__((unused)), StObject expr)
+{
+    // (define-optional (name a ... (b default) ... [. rest]) body ...)
+    // =>
+    // (define name
+    //   (let1 full (lambda (a ... b ... [rest]) body ...)
+    //     (---case-lambda---
+    //       (lambda (a ...) (let1 b default ... (full a ... b ... [()])))
+    //       ...
+    //       full or (lambda (a ... b ... . rest) (full a ... b ... rest)))))
+    //
+    // Calls with fewer arguments fill in the defaults without allocating a
+    // rest list.
+
+    if (St_Length(expr) < 3 || !ST_PAIRP(ST_CADR(expr)) || !ST_SYMBOLP(ST_CAR(ST_CADR(expr))))
+    {
+        St_Error("define-optional: malformed define-optional");
+    }
+
+    StObject name = ST_CAR(ST_CADR(expr));
+    StObject body = ST_CDDR(expr);
+    StObject required = Nil, rtail = Nil;
+    StObject optionals = Nil, otail = Nil;
+    StObject p;
+
+    for (p = ST_CDR(ST_CADR(expr)); ST_PAIRP(p); p = ST_CDR(p)) {
+        StObject param = ST_CAR(p);
+
+        if (ST_SYMBOLP(param) && ST_NULLP(optionals))
+        {
+            ST_APPEND1(required, rtail, param);
+        }
+        else if (ST_PAIRP(param) && St_Length(param) == 2 && ST_SYMBOLP(ST_CAR(param)))
+        {
+            ST_APPEND1(optionals, otail, param);
+        }
+        else
+        {
+            St_Error("define-optional: malformed parameter");
+        }
+    }
+
+    StObject rest = p;
+    if (!ST_NULLP(rest) && !ST_SYMBOLP(rest))
+    {
+        St_Error("define-optional: malformed rest parameter");
+    }
+
+    StObject full = St_Gensym();
+    StObject params = St_Append(required, Nil);
+    StObject clauses = Nil, tail = Nil;
+
+    ST_FOREACH(o, optionals) {
+        StObject args = St_Append(params, Nil);
+        ST_FOREACH(q, o) {
+            args = St_Append(args, ST_LIST1(ST_CAAR(q)));
+        }
+        if (!ST_NULLP(rest))
+        {
+            args = St_Append(args, ST_LIST1(ST_LIST2(I("quote"), Nil)));
+        }
+
+        StObject call = St_Cons(full, args);
+        ST_FOREACH(q, St_Reverse(o)) {
+            call = ST_LIST4(I("let1"), ST_CAAR(q), ST_CADR(ST_CAR(q)), call);
+        }
+
+        ST_APPEND1(clauses, tail, ST_LIST3(I("lambda"), params, call));
+        params = St_Append(params, ST_LIST1(ST_CAAR(o)));
+    }
+
+    if (ST_NULLP(rest))
+    {
+        ST_APPEND1(clauses, tail, full);
+    }
+    else
+    {
+        ST_APPEND1(clauses, tail, ST_LIST3(I("lambda"), St_Append(params, rest),
+                                           St_Cons(full, St_Append(params, ST_LIST1(rest)))));
+        params = St_Append(params, ST_LIST1(rest));
+    }
+
+    StObject lambda = St_Cons(I("lambda"), St_Cons(params, body));
+
+    return ST_LIST3(I("define"), name,
+                    ST_LIST4(I("let1"), full, lambda, St_Cons(I("---case-lambda---"), clauses)));
+}
+
+static StObject syntax_receive(StObject module __attribute__((unused)), StObject expr)
+{
+    // (receive formals expr body ...)
+    // =>
+    // (---call-with-values--- (lambda () expr) (lambda formals body ...))
+
+    if (St_Length(expr) < 4)
+    {
+        St_Error("receive: malformed receive");
+    }
+
+    return ST_LIST3(I("---call-with-values---"),
+                    ST_LIST3(I("lambda"), Nil, ST_CADDR(expr)),
+                    St_Cons(I("lambda"), St_Cons(ST_CADR(expr), ST_CDR(ST_CDDR(expr)))));
+}
+
+static StObject syntax_call_with_values(StObject module __attribute__((unused)), StObject expr)
+{
+    if (St_Length(expr) != 3)
+    {
+        St_Error("call-with-values: wrong number of arguments");
+    }
+
+    return St_Cons(I("---call-with-values---"), ST_CDR(expr));
+}
+
+static StObject let_values_expand(StObject bindings, StObject body)
+{
+    if (ST_NULLP(bindings))
+    {
+        return St_Cons(I("let"), St_Cons(Nil, body));
+    }
+
+    StObject b = ST_CAR(bindings);
+    if (!ST_PAIRP(b) || St_Length(b) != 2)
+    {
+        St_Error("let-values: malformed binding");
+    }
+
+    return ST_LIST4(I("receive"), ST_CAR(b), ST_CADR(b), let_values_expand(ST_CDR(bindings), body));
+}
+
+static StObject syntax_let_values(StObject module __attribute__((unused)), StObject expr)
+{
+    // (let-values ((formals expr) ...) body ...)
+    // =>
+    // (receive formals' expr ... (let ((var tmp) ...) body ...))
+    //
+    // The variables are received into temporaries so that every expr is in
+    // the scope outside the let-values.
+
+    if (St_Length(expr) < 3 || !St_ListP(ST_CADR(expr)))
+    {
+        St_Error("let-values: malformed let-values");
+    }
+
+    StObject bindings = Nil, btail = Nil;
+    StObject renames = Nil, rtail = Nil;
+
+    ST_FOREACH(p, ST_CADR(expr)) {
+        StObject b = ST_CAR(p);
+        if (!ST_PAIRP(b) || St_Length(b) != 2)
+        {
+            St_Error("let-values: malformed binding");
+        }
+
+        StObject formals = Nil, ftail = Nil;
+        StObject q;
+        for (q = ST_CAR(b); ST_PAIRP(q); q = ST_CDR(q)) {
+            StObject t = St_Gensym();
+            ST_APPEND1(formals, ftail, t);
+            ST_APPEND1(renames, rtail, ST_LIST2(ST_CAR(q), t));
+        }
+        if (!ST_NULLP(q))
+        {
+            StObject t = St_Gensym();
+            if (ST_NULLP(formals))
+            {
+                formals = t;
+            }
+            else
+            {
+                ST_CDR_SET(ftail, t);
+            }
+            ST_APPEND1(renames, rtail, ST_LIST2(q, t));
+        }
+
+        ST_APPEND1(bindings, btail, ST_LIST2(formals, ST_CADR(b)));
+    }
+
+    return let_values_expand(bindings, ST_LIST1(St_Cons(I("let"), St_Cons(renames, ST_CDDR(expr)))));
+}
+
+static StObject syntax_let_star_values(StObject module __attribute__((unused)), StObject expr)
+{
+    // (let*-values ((formals expr) ...) body ...)
+    // =>
+    // (receive formals expr ... (let () body ...))
+
+    if (St_Length(expr) < 3 || !St_ListP(ST_CADR(expr)))
+    {
+        St_Error("let*-values: malformed let*-values");
+    }
+
+    return let_values_expand(ST_CADR(expr), ST_CDDR(expr));
+}
+
+static StObject syntax_let_ec(StObject module __attribute__((unused)), StObject expr)
+{
+    // (let/ec k body ...)
+    // =>
+    // (call/ec (lambda (k) body ...))
+
+    if (St_Length(expr) < 3 || !ST_SYMBOLP(ST_CADR(expr)))
+    {
+        St_Error("let/ec: malformed let/ec");
+    }
+
+    return ST_LIST2(I("call/ec"),
+                    St_Cons(I("lambda"), St_Cons(ST_LIST1(ST_CADR(expr)), ST_CDDR(expr))));
+}
+
+static StObject RaiseContinuable;
+
+static StObject syntax_guard(StObject module __attribute__((unused)), StObject expr)
+{
+    // (guard (var clause ...) body ...)
+    // =>
+    // (---handler--- #t
+    //   (lambda (var) (cond clause ... (else (raise-continuable var))))
+    //   (lambda () body ...))
+    //
+    // The handler runs after the stack is unwound to the guard.
+
+    if (St_Length(expr) < 3 || !ST_PAIRP(ST_CADR(expr)) || !ST_SYMBOLP(ST_CAR(ST_CADR(expr))) ||
+        !St_ListP(ST_CADR(expr)))
+    {
+        St_Error("guard: malformed guard");
+    }
+
+    StObject var = ST_CAR(ST_CADR(expr));
+    StObject clauses = ST_CDR(ST_CADR(expr));
+    StObject last = ST_NULLP(clauses) ? Nil : ST_CAR(St_Reverse(clauses));
+
+    if (!ST_PAIRP(last) || ST_CAR(last) != I("else"))
+    {
+        StObject reraise = ST_LIST2(ST_LIST2(I("quote"), RaiseContinuable), var);
+        clauses = St_Append(clauses, ST_LIST1(ST_LIST2(I("else"), reraise)));
+    }
+
+    return ST_LIST4(I("---handler---"), True,
+                    ST_LIST3(I("lambda"), ST_LIST1(var), St_Cons(I("cond"), clauses)),
+                    St_Cons(I("lambda"), St_Cons(Nil, ST_CDDR(expr))));
+}
+
+static StObject syntax_with_exception_handler(StObject module __attribute__((unused)), StObject expr)
+{
+    // (with-exception-handler handler thunk)
+    // =>
+    // (---handler--- #f handler thunk)
+
+    if (St_Length(expr) != 3)
+    {
+        St_Error("with-exception-handler: wrong number of arguments");
+    }
+
+    return St_Cons(I("---handler---"), St_Cons(False, ST_CDR(expr)));
+}
+
+static StObject syntax_dynamic_wind(StObject module __attribute__((unused)), StObject expr)
+{
+    // (dynamic-wind before thunk after)
+    // =>
+    // (---wind--- before thunk after)
+
+    if (St_Length(expr) != 4)
+    {
+        St_Error("dynamic-wind: wrong number of arguments");
+    }
+
+    return St_Cons(I("---wind---"), ST_CDR(expr));
+}
+
+static StObject syntax_parameterize(StObject module __attribute__((unused)), StObject expr)
+{
+    // (parameterize ((param value) ...) body ...)
+    // =>
+    // (---parameterize--- param value ... (lambda () body ...))
+
+    if (St_Length(expr) < 3 || !St_ListP(ST_CADR(expr)))
+    {
+        St_Error("parameterize: malformed parameterize");
+    }
+
+    StObject h = Nil, t = Nil;
+
+    ST_FOREACH(p, ST_CADR(expr)) {
+        StObject binding = ST_CAR(p);
+        if (!ST_PAIRP(binding) || St_Length(binding) != 2)
+        {
+            St_Error("parameterize: malformed binding");
+        }
+        ST_APPEND1(h, t, ST_CAR(binding));
+        ST_APPEND1(h, t, ST_CADR(binding));
+    }
+    ST_APPEND1(h, t, St_Cons(I("lambda"), St_Cons(Nil, ST_CDDR(expr))));
+
+    return St_Cons(I("---parameterize---"), h);
+}
+
+// match
+//
+// (match expr (pattern body ...) ...)
+//
+// <pattern> ::= _ | <symbol> | <literal> | (quote <datum>) | ()
+//             | (<pattern> . <pattern>) | (? <expr> <pattern> ...)
+//             | (and <pattern> ...)
+//
+// The clauses are compiled into a decision tree over a matrix of patterns,
+// one row per clause and one column per subterm. Each subterm is tested at
+// most once on a path and is bound to a let variable on the stack, so that
+// the car and cdr of a pair are loaded only once however many clauses look
+// into them. Pattern variables are bound from these slots at the leaves.
+//
+// Patterns are parsed into (any), (var x), (lit test datum), (pair p q),
+// (pred e) and (and p q). The primitives used by the tests are referred as
+// constants so that user definitions do not change their meaning.
+
+static StObject MatchAny;
+static StObject MatchPairP, MatchCar, MatchCdr, MatchEqvP, MatchEqualP, MatchNullP, MatchFailure;
+
+static StObject match_failure(StCallInfo *cinfo __attribute__((unused)))
+{
+    St_Error("match: no matching pattern");
+}
+
+static StObject match_quote(StObject datum)
+{
+    if (ST_PAIRP(datum))
+    {
+        return ST_LIST3(I("pair"), match_quote(ST_CAR(datum)), match_quote(ST_CDR(datum)));
+    }
+
+    if (ST_NULLP(datum))
+    {
+        return ST_LIST3(I("lit"), MatchNullP, Nil);
+    }
+
+    if (ST_STRINGP(datum) || ST_VECTORP(datum) || ST_BYTEVECTORP(datum))
+    {
+        return ST_LIST3(I("lit"), MatchEqualP, datum);
+    }
+
+    return ST_LIST3(I("lit"), MatchEqvP, datum);
+}
+
+static StObject match_and(StObject pats);
+
+static StObject match_parse(StObject pat, StObject *vars)
+{
+    if (pat == I("_"))
+    {
+        return MatchAny;
+    }
+
+    if (pat == I("..."))
+    {
+        St_Error("match: ellipsis is not supported");
+    }
+
+    if (ST_SYMBOLP(pat))
+    {
+        if (St_SetMemberP(pat, *vars))
+        {
+            St_Error("match: duplicated pattern variable: %s", ST_SYMBOL_VALUE(pat));
+        }
+        *vars = St_Cons(pat, *vars);
+        return ST_LIST2(I("var"), pat);
+    }
+
+    if (!ST_PAIRP(pat))
+    {
+        return match_quote(pat);
+    }
+
+    StObject car = ST_CAR(pat);
+
+    if (car == I("quote") && ST_PAIRP(ST_CDR(pat)) && ST_NULLP(ST_CDDR(pat)))
+    {
+        return match_quote(ST_CADR(pat));
+    }
+
+    if (car == I("?") && ST_PAIRP(ST_CDR(pat)) && St_ListP(pat))
+    {
+        StObject pats = Nil, tail = Nil;
+        ST_FOREACH(p, ST_CDDR(pat)) {
+            ST_APPEND1(pats, tail, match_parse(ST_CAR(p), vars));
+        }
+        return ST_LIST3(I("and"), ST_LIST2(I("pred"), ST_CADR(pat)), match_and(pats));
+    }
+
+    if (car == I("and") && St_ListP(pat))
+    {
+        StObject pats = Nil, tail = Nil;
+        ST_FOREACH(p, ST_CDR(pat)) {
+            ST_APPEND1(pats, tail, match_parse(ST_CAR(p), vars));
+        }
+        return match_and(pats);
+    }
+
+    StObject p = match_parse(car, vars);
+    return ST_LIST3(I("pair"), p, match_parse(ST_CDR(pat), vars));
+}
+
+// (and p1 p2 p3) => (and p1 (and p2 p3))
+static StObject match_and(StObject pats)
+{
+    if (ST_NULLP(pats))
+    {
+        return MatchAny;
+    }
+
+    if (ST_NULLP(ST_CDR(pats)))
+    {
+        return ST_CAR(pats);
+    }
+
+    return ST_LIST3(I("and"), ST_CAR(pats), match_and(ST_CDR(pats)));
+}
+
+#define MATCH_KIND(p) ST_CAR(p)
+
+// a row is (patterns bindings . body)
+#define MATCH_ROW(pats, binds, body) St_Cons((pats), St_Cons((binds), (body)))
+#define MATCH_ROW_PATS(r) ST_CAR(r)
+#define MATCH_ROW_BINDS(r) ST_CADR(r)
+#define MATCH_ROW_BODY(r) ST_CDDR(r)
+
+static StObject match_nth(StObject list, int i)
+{
+    while (i-- > 0)
+    {
+        list = ST_CDR(list);
+    }
+    return ST_CAR(list);
+}
+
+// replaces the i-th element of list with the elements of news
+static StObject match_splice(StObject list, int i, StObject news)
+{
+    if (i == 0)
+    {
+        return St_Append(news, ST_CDR(list));
+    }
+    return St_Cons(ST_CAR(list), match_splice(ST_CDR(list), i - 1, news));
+}
+
+// moves pattern variables into the bindings and drops the columns matched
+// by any pattern in every row
+static StObject match_prune(StObject *occs, StObject rows)
+{
+    StObject nrows = Nil, tail = Nil;
+
+    ST_FOREACH(r, rows) {
+        StObject pats = Nil, ptail = Nil;
+        StObject binds = MATCH_ROW_BINDS(ST_CAR(r));
+        StObject o = *occs;
+
+        ST_FOREACH(p, MATCH_ROW_PATS(ST_CAR(r))) {
+            StObject pat = ST_CAR(p);
+            if (MATCH_KIND(pat) == I("var"))
+            {
+                binds = St_Cons(St_Cons(ST_CADR(pat), ST_CAR(o)), binds);
+                pat = MatchAny;
+            }
+            ST_APPEND1(pats, ptail, pat);
+            o = ST_CDR(o);
+        }
+        ST_APPEND1(nrows, tail, MATCH_ROW(pats, binds, MATCH_ROW_BODY(ST_CAR(r))));
+    }
+
+    for (int i = St_Length(*occs) - 1; i >= 0; i--) {
+        bool used = false;
+        ST_FOREACH(r, nrows) {
+            if (match_nth(MATCH_ROW_PATS(ST_CAR(r)), i) != MatchAny)
+            {
+                used = true;
+                break;
+            }
+        }
+
+        if (!used)
+        {
+            *occs = match_splice(*occs, i, Nil);
+            ST_FOREACH(r, nrows) {
+                ST_CAR_SET(ST_CAR(r), match_splice(MATCH_ROW_PATS(ST_CAR(r)), i, Nil));
+            }
+        }
+    }
+
+    return nrows;
+}
+
+// builds a leaf binding the pattern variables from the subterm slots
+static StObject match_leaf(StObject row)
+{
+    StObject vars = Nil, vals = Nil;
+
+    ST_FOREACH(p, MATCH_ROW_BINDS(row)) {
+        vars = St_Cons(ST_CAAR(p), vars);
+        vals = St_Cons(ST_CDAR(p), vals);
+    }
+
+    return St_Cons(St_Cons(I("lambda"), St_Cons(vars, MATCH_ROW_BODY(row))), vals);
+}
+
+static bool match_same_testP(StObject p, StObject q)
+{
+    if (MATCH_KIND(q) != MATCH_KIND(p))
+    {
+        return false;
+    }
+
+    if (MATCH_KIND(p) == I("lit"))
+    {
+        return ST_CADR(p) == ST_CADR(q) && St_EqualP(ST_CADDR(p), ST_CADDR(q));
+    }
+
+    return MATCH_KIND(p) == I("pair") || St_EqualP(ST_CADR(p), ST_CADR(q));
+}
+
+// true if q can not match when the test of p succeeds
+static bool match_disjointP(StObject p, StObject q)
+{
+    StObject pk = MATCH_KIND(p);
+    StObject qk = MATCH_KIND(q);
+
+    return (pk == I("pair") && qk == I("lit"))
+        || (pk == I("lit") && qk == I("pair"))
+        || (pk == I("lit") && qk == I("lit") && !match_same_testP(p, q));
+}
+
+static StObject match_tree(StObject occs, StObject rows)
+{
+    rows = match_prune(&occs, rows);
+
+    if (ST_NULLP(rows))
+    {
+        return ST_LIST1(ST_LIST2(I("quote"), MatchFailure));
+    }
+
+    // tests the first column the first clause depends on
+    StObject first = MATCH_ROW_PATS(ST_CAR(rows));
+    int i = 0;
+    while (!ST_NULLP(first) && ST_CAR(first) == MatchAny)
+    {
+        first = ST_CDR(first);
+        i++;
+    }
+
+    if (ST_NULLP(first))
+    {
+        return match_leaf(ST_CAR(rows));
+    }
+
+    StObject pat = ST_CAR(first);
+    StObject kind = MATCH_KIND(pat);
+    StObject occ = match_nth(occs, i);
+
+    if (kind == I("and"))
+    {
+        // matches both patterns against the same subterm
+        StObject nrows = Nil, tail = Nil;
+
+        ST_FOREACH(r, rows) {
+            StObject row = ST_CAR(r);
+            StObject q = match_nth(MATCH_ROW_PATS(row), i);
+            StObject news = MATCH_KIND(q) == I("and")
+                ? ST_CDR(q)
+                : ST_LIST2(q, MatchAny);
+
+            ST_APPEND1(nrows, tail, MATCH_ROW(match_splice(MATCH_ROW_PATS(row), i, news),
+                                              MATCH_ROW_BINDS(row), MATCH_ROW_BODY(row)));
+        }
+
+        return match_tree(match_splice(occs, i, ST_LIST2(occ, occ)), nrows);
+    }
+
+    StObject srows = Nil, stail = Nil;
+    StObject frows = Nil, ftail = Nil;
+    StObject a = Nil, d = Nil;
+    StObject soccs = occs;
+
+    if (kind == I("pair"))
+    {
+        a = St_Gensym();
+        d = St_Gensym();
+        soccs = match_splice(occs, i, ST_LIST3(a, d, occ));
+    }
+
+    ST_FOREACH(r, rows) {
+        StObject row = ST_CAR(r);
+        StObject pats = MATCH_ROW_PATS(row);
+        StObject q = match_nth(pats, i);
+        StObject news;
+
+        if (match_same_testP(pat, q))
+        {
+            news = kind == I("pair")
+                ? ST_LIST3(ST_CADR(q), ST_CADDR(q), MatchAny)
+                : ST_LIST1(MatchAny);
+        }
+        else if (match_disjointP(pat, q))
+        {
+            news = Nil;
+        }
+        else
+        {
+            news = kind == I("pair")
+                ? ST_LIST3(MatchAny, MatchAny, q)
+                : ST_LIST1(q);
+        }
+
+        if (!ST_NULLP(news))
+        {
+            ST_APPEND1(srows, stail, MATCH_ROW(match_splice(pats, i, news),
+                                               MATCH_ROW_BINDS(row), MATCH_ROW_BODY(row)));
+        }
+
+        if (!match_same_testP(pat, q))
+        {
+            ST_APPEND1(frows, ftail, row);
+        }
+    }
+
+    StObject test, success;
+
+    if (kind == I("pair"))
+    {
+        test = ST_LIST2(ST_LIST2(I("quote"), MatchPairP), occ);
+        success = ST_LIST3(ST_LIST3(I("lambda"), ST_LIST2(a, d), match_tree(soccs, srows)),
+                           ST_LIST2(ST_LIST2(I("quote"), MatchCar), occ),
+                           ST_LIST2(ST_LIST2(I("quote"), MatchCdr), occ));
+    }
+    else
+    {
+        test = kind == I("lit")
+            ? (ST_CADR(pat) == MatchNullP
+               ? ST_LIST2(ST_LIST2(I("quote"), MatchNullP), occ)
+               : ST_LIST3(ST_LIST2(I("quote"), ST_CADR(pat)), occ, ST_LIST2(I("quote"), ST_CADDR(pat))))
+            : ST_LIST2(ST_CADR(pat), occ);
+        success = match_tree(soccs, srows);
+    }
+
+    return ST_LIST4(I("if"), test, success, match_tree(occs, frows));
+}
+
+static StObject syntax_match(StObject module __attribute__((unused)), StObject expr)
+{
+    // (match expr (pattern body ...) ...)
+    // =>
+    // ((lambda (t) <decision tree>) expr)
+
+    if (St_Length(expr) < 2)
+    {
+        St_Error("match: malformed match");
+    }
+
+    StObject occ = St_Gensym();
+    StObject rows = Nil, tail = Nil;
+
+    ST_FOREACH(p, ST_CDDR(expr)) {
+        StObject clause = ST_CAR(p);
+        StObject vars = Nil;
+
+        if (!ST_PAIRP(clause) || !ST_PAIRP(ST_CDR(clause)))
+        {
+            St_Error("match: malformed match clause");
+        }
+
+        ST_APPEND1(rows, tail, MATCH_ROW(ST_LIST1(match_parse(ST_CAR(clause), &vars)), Nil, ST_CDR(clause)));
+    }
 
-    return St_SyntaxExpand(module, ret);
+    return ST_LIST2(ST_LIST3(I("lambda"), ST_LIST1(occ), match_tree(ST_LIST1(occ), rows)),
+                    ST_CADR(expr));
 }
 
 void St_InitSyntax(void)
@@ -217,4 +971,30 @@ void St_InitSyntax(void)
     St_AddSyntax(m, "define", syntax_define);
     St_AddSyntax(m, "cond", syntax_cond);
     St_AddSyntax(m, "case", syntax_case);
+    St_AddSyntax(m, "match", syntax_match);
+    St_AddSyntax(m, "case-lambda", syntax_case_lambda);
+    St_AddSyntax(m, "define-optional", syntax_define_optional);
+    St_AddSyntax(m, "receive", syntax_receive);
+    St_AddSyntax(m, "call-with-values", syntax_call_with_values);
+    St_AddSyntax(m, "let-values", syntax_let_values);
+    St_AddSyntax(m, "let*-values", syntax_let_star_values);
+    St_AddSyntax(m, "let/ec", syntax_let_ec);
+    St_AddSyntax(m, "guard", syntax_guard);
+    St_AddSyntax(m, "with-exception-handler", syntax_with_exception_handler);
+    St_AddSyntax(m, "dynamic-wind", syntax_dynamic_wind);
+    St_AddSyntax(m, "parameterize", syntax_parameterize);
+
+    RaiseContinuable = St_ModuleFind(m, I("raise-continuable"));
+
+    MatchAny = ST_LIST1(I("any"));
+    MatchPairP = St_ModuleFind(m, I("pair?"));
+    MatchCar = St_ModuleFind(m, I("car"));
+    MatchCdr = St_ModuleFind(m, I("cdr"));
+    MatchEqvP = St_ModuleFind(m, I("eqv?"));
+    MatchEqualP = St_ModuleFind(m, I("equal?"));
+    MatchNullP = St_ModuleFind(m, I("null?"));
+
+    MatchFailure = St_Alloc2(TSUBR, sizeof(struct StSubrRec));
+    ST_SUBR_BODY(MatchFailure) = match_failure;
+    ST_SUBR_NAME(MatchFailure) = "match-failure";
 }
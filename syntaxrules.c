@@ -0,0 +1,783 @@
+#include "lisp.h"
+
+// syntax-rules
+//
+// Patterns and templates are compiled into trees of nodes once when the
+// syntax-rules form is compiled. An expansion matches the form against
+// the patterns and instantiates the template directly, without running
+// the VM.
+//
+// Hygiene is partial: symbols the template binds with lambda, let, do,
+// internal define and the like are renamed to fresh symbols within the
+// binding form on each expansion, so that they can't capture the
+// variables of the macro use. Other symbols in a template, and names it
+// defines at toplevel, are inserted as they are, like define-macro.
+
+#define I(x) St_Intern(x)
+
+typedef enum {
+    PAT_ANY = 1,  // _
+    PAT_VAR,
+    PAT_LITERAL,
+    PAT_DATUM,
+    PAT_NIL,
+    PAT_PAIR,
+    PAT_ELLIPSIS, // (p ... . rest)
+    PAT_VECTOR,
+} PatternType;
+
+typedef struct Pattern Pattern;
+struct Pattern
+{
+    PatternType type;
+    int slot;       // PAT_VAR
+    StObject datum; // PAT_LITERAL, PAT_DATUM
+    Pattern *car;   // PAT_PAIR, PAT_ELLIPSIS: repeated pattern, PAT_VECTOR: elements
+    Pattern *cdr;   // PAT_PAIR, PAT_ELLIPSIS: pattern after the ellipsis
+    int min_len;    // PAT_ELLIPSIS: number of pairs required after the repetition
+    int *vars;      // PAT_ELLIPSIS: slots bound in the repeated pattern
+    int nvars;
+};
+
+typedef enum {
+    TMPL_DATUM = 1,
+    TMPL_VAR,
+    TMPL_PAIR,
+    TMPL_ELLIPSIS, // (t ... . rest)
+    TMPL_VECTOR,
+} TemplateType;
+
+typedef struct Template Template;
+struct Template
+{
+    TemplateType type;
+    StObject datum;  // TMPL_DATUM
+    int slot;        // TMPL_VAR
+    Template *car;   // TMPL_PAIR, TMPL_ELLIPSIS: repeated template, TMPL_VECTOR: elements
+    Template *cdr;   // TMPL_PAIR, TMPL_ELLIPSIS: template after the ellipses
+    int depth;       // TMPL_ELLIPSIS: number of ellipses following the repeated template
+    int *vars;       // TMPL_ELLIPSIS: slots iterated over
+    int *var_depths; // TMPL_ELLIPSIS: number of ellipsis levels each slot iterates
+    int nvars;
+};
+
+struct SyntaxRule
+{
+    Pattern *pattern;
+    Template *template;
+    int nslots;
+    int nrenames; // slots after the pattern variables hold the renames
+};
+
+struct StSyntaxRulesRec
+{
+    ST_EXTERNAL_OBJECT_HEADER;
+    int nrules;
+    struct SyntaxRule rules[];
+};
+typedef struct StSyntaxRulesRec *StSyntaxRules;
+#define ST_SYNTAX_RULES(x) ((StSyntaxRules)(x))
+
+static void display(StObject obj, StObject port)
+{
+    (void)obj;
+    St_WriteCString("#<syntax-rules>", port);
+}
+
+static bool equalp(StObject lhs, StObject rhs)
+{
+    return lhs == rhs;
+}
+
+static StExternalTypeInfo SyntaxRulesTypeInfo = (StExternalTypeInfo) { "<syntax-rules>", display, equalp };
+
+static StObject vector_to_list(StObject v)
+{
+    StObject l = Nil;
+
+    for (int i = ST_VECTOR_LENGTH(v) - 1; i >= 0; i--) {
+        l = St_Cons(ST_VECTOR_DATA(v)[i], l);
+    }
+    return l;
+}
+
+// Compiler
+
+typedef struct
+{
+    StObject ellipsis;
+    StObject literals;
+    StObject vars; // alist of (symbol slot . depth)
+    int nslots;
+    StObject renames; // alist of (marker . slot) of the symbols the template binds
+} RuleCompiler;
+
+static Pattern *compile_pattern(RuleCompiler *rc, StObject pat, int depth)
+{
+    Pattern *p = St_Malloc(sizeof(Pattern));
+
+    if (ST_SYMBOLP(pat))
+    {
+        if (pat == rc->ellipsis)
+        {
+            St_Error("syntax-rules: misplaced ellipsis");
+        }
+
+        if (ST_TRUTHYP(St_Memq(pat, rc->literals)))
+        {
+            p->type = PAT_LITERAL;
+            p->datum = pat;
+        }
+        else if (pat == I("_"))
+        {
+            p->type = PAT_ANY;
+        }
+        else
+        {
+            if (ST_TRUTHYP(St_Assq(pat, rc->vars)))
+            {
+                St_Error("syntax-rules: duplicate pattern variable %s", ST_SYMBOL_VALUE(pat));
+            }
+            p->type = PAT_VAR;
+            p->slot = rc->nslots++;
+            rc->vars = St_Acons(pat, St_Cons(St_Integer(p->slot), St_Integer(depth)), rc->vars);
+        }
+    }
+    else if (ST_PAIRP(pat) && ST_PAIRP(ST_CDR(pat)) && ST_CADR(pat) == rc->ellipsis)
+    {
+        StObject before = rc->vars;
+
+        p->type = PAT_ELLIPSIS;
+        p->car = compile_pattern(rc, ST_CAR(pat), depth + 1);
+
+        p->nvars = 0;
+        for (StObject v = rc->vars; v != before; v = ST_CDR(v)) {
+            p->nvars++;
+        }
+        p->vars = St_Malloc(sizeof(int) * (p->nvars + 1));
+        int i = 0;
+        for (StObject v = rc->vars; v != before; v = ST_CDR(v)) {
+            p->vars[i++] = ST_INT_VALUE(ST_CAR(ST_CDAR(v)));
+        }
+
+        p->cdr = compile_pattern(rc, ST_CDDR(pat), depth);
+        p->min_len = 0;
+        for (StObject q = ST_CDDR(pat); ST_PAIRP(q); q = ST_CDR(q)) {
+            p->min_len++;
+        }
+    }
+    else if (ST_PAIRP(pat))
+    {
+        p->type = PAT_PAIR;
+        p->car = compile_pattern(rc, ST_CAR(pat), depth);
+        p->cdr = compile_pattern(rc, ST_CDR(pat), depth);
+    }
+    else if (ST_NULLP(pat))
+    {
+        p->type = PAT_NIL;
+    }
+    else if (ST_VECTORP(pat))
+    {
+        p->type = PAT_VECTOR;
+        p->car = compile_pattern(rc, vector_to_list(pat), depth);
+    }
+    else
+    {
+        p->type = PAT_DATUM;
+        p->datum = pat;
+    }
+
+    return p;
+}
+
+// pattern variables occurring in tmpl deeper than depth
+static StObject template_vars(RuleCompiler *rc, StObject tmpl, int depth, StObject found)
+{
+    if (ST_SYMBOLP(tmpl))
+    {
+        StObject v = St_Assq(tmpl, rc->vars);
+        if (ST_TRUTHYP(v) && ST_INT_VALUE(ST_CDDR(v)) > depth && ST_FALSEP(St_Memq(v, found)))
+        {
+            return St_Cons(v, found);
+        }
+    }
+    else if (ST_PAIRP(tmpl))
+    {
+        return template_vars(rc, ST_CDR(tmpl), depth, template_vars(rc, ST_CAR(tmpl), depth, found));
+    }
+    else if (ST_VECTORP(tmpl))
+    {
+        return template_vars(rc, vector_to_list(tmpl), depth, found);
+    }
+    return found;
+}
+
+// Renaming
+//
+// Before the template is compiled, a symbol it binds is replaced by a
+// marker within the scope of the binding form. Each marker takes a slot,
+// which holds a fresh symbol on each expansion. env is an alist of
+// (symbol . marker) of the bindings in scope. Names defined at toplevel,
+// or in a begin at toplevel, are left as they are.
+
+static StObject rename(RuleCompiler *rc, StObject x, StObject env);
+
+static StObject bind(RuleCompiler *rc, StObject sym, StObject *env)
+{
+    if (!ST_SYMBOLP(sym) || sym == rc->ellipsis || ST_TRUTHYP(St_Assq(sym, rc->vars)))
+    {
+        return sym;
+    }
+
+    StObject marker = St_Gensym();
+    rc->renames = St_Acons(marker, St_Integer(rc->nslots++), rc->renames);
+    *env = St_Acons(sym, marker, *env);
+
+    return marker;
+}
+
+static StObject rename_each(RuleCompiler *rc, StObject list, StObject env)
+{
+    StObject h = Nil, t = Nil;
+
+    for (; ST_PAIRP(list); list = ST_CDR(list)) {
+        ST_APPEND1(h, t, rename(rc, ST_CAR(list), env));
+    }
+
+    StObject rest = rename(rc, list, env);
+    if (ST_NULLP(h))
+    {
+        return rest;
+    }
+    ST_CDR_SET(t, rest);
+    return h;
+}
+
+// (a b . c) or a
+static StObject bind_formals(RuleCompiler *rc, StObject formals, StObject *env)
+{
+    if (!ST_PAIRP(formals))
+    {
+        return bind(rc, formals, env);
+    }
+
+    StObject car = bind(rc, ST_CAR(formals), env);
+    return St_Cons(car, bind_formals(rc, ST_CDR(formals), env));
+}
+
+// names of the internal definitions of a body, begins included
+static void bind_defines(RuleCompiler *rc, StObject body, StObject *env)
+{
+    ST_FOREACH(p, body) {
+        StObject x = ST_CAR(p);
+
+        if (!ST_PAIRP(x) || !ST_PAIRP(ST_CDR(x)))
+        {
+            continue;
+        }
+
+        if (ST_CAR(x) == I("begin"))
+        {
+            bind_defines(rc, ST_CDR(x), env);
+        }
+        else if (ST_CAR(x) == I("define"))
+        {
+            StObject name = ST_CADR(x);
+            while (ST_PAIRP(name)) {
+                name = ST_CAR(name);
+            }
+            bind(rc, name, env);
+        }
+    }
+}
+
+static StObject rename_body(RuleCompiler *rc, StObject body, StObject env)
+{
+    bind_defines(rc, body, &env);
+    return rename_each(rc, body, env);
+}
+
+// ((var init ...) ...): inits see init_env, and the vars are bound in env
+static StObject rename_bindings(RuleCompiler *rc, StObject bindings, StObject init_env, StObject *env, bool sequential)
+{
+    StObject h = Nil, t = Nil;
+
+    for (; ST_PAIRP(bindings); bindings = ST_CDR(bindings)) {
+        StObject b = ST_CAR(bindings);
+
+        if (!ST_PAIRP(b))
+        {
+            ST_APPEND1(h, t, rename(rc, b, init_env));
+            continue;
+        }
+
+        StObject rest = rename_each(rc, ST_CDR(b), sequential ? *env : init_env);
+        ST_APPEND1(h, t, St_Cons(bind(rc, ST_CAR(b), env), rest));
+    }
+
+    return h;
+}
+
+// the name of (define name ...) or (define ((name a) b) ...), whose
+// parameters are bound in body_env
+static StObject rename_define_target(RuleCompiler *rc, StObject target, StObject env, StObject *body_env)
+{
+    if (!ST_PAIRP(target))
+    {
+        return rename(rc, target, env);
+    }
+
+    StObject car = rename_define_target(rc, ST_CAR(target), env, body_env);
+    return St_Cons(car, bind_formals(rc, ST_CDR(target), body_env));
+}
+
+static StObject rename(RuleCompiler *rc, StObject x, StObject env)
+{
+    if (ST_SYMBOLP(x))
+    {
+        StObject r = St_Assq(x, env);
+        return ST_FALSEP(r) ? x : ST_CDR(r);
+    }
+
+    if (!ST_PAIRP(x) || !ST_SYMBOLP(ST_CAR(x)) || !ST_PAIRP(ST_CDR(x))
+        || ST_TRUTHYP(St_Assq(ST_CAR(x), env)))
+    {
+        return ST_PAIRP(x) ? rename_each(rc, x, env) : x;
+    }
+
+    StObject head = ST_CAR(x);
+    StObject a = ST_CADR(x);
+    StObject rest = ST_CDDR(x);
+    StObject inner = env;
+
+    if (head == I("quote"))
+    {
+        return x;
+    }
+
+    if (head == I("lambda"))
+    {
+        StObject formals = bind_formals(rc, a, &inner);
+        return St_Cons(head, St_Cons(formals, rename_body(rc, rest, inner)));
+    }
+
+    if (head == I("receive") && ST_PAIRP(rest))
+    {
+        StObject expr = rename(rc, ST_CAR(rest), env);
+        StObject formals = bind_formals(rc, a, &inner);
+        return St_Cons(head, St_Cons(formals, St_Cons(expr, rename_body(rc, ST_CDR(rest), inner))));
+    }
+
+    if (head == I("let1") && ST_PAIRP(rest))
+    {
+        StObject expr = rename(rc, ST_CAR(rest), env);
+        StObject var = bind(rc, a, &inner);
+        return St_Cons(head, St_Cons(var, St_Cons(expr, rename_body(rc, ST_CDR(rest), inner))));
+    }
+
+    if (head == I("let") && ST_SYMBOLP(a) && ST_PAIRP(rest))
+    {
+        // named let
+        StObject bindings = rename_bindings(rc, ST_CAR(rest), env, &inner, false);
+        StObject name = bind(rc, a, &inner);
+        return St_Cons(head, St_Cons(name, St_Cons(bindings, rename_body(rc, ST_CDR(rest), inner))));
+    }
+
+    if (head == I("let") || head == I("let*"))
+    {
+        StObject bindings = rename_bindings(rc, a, env, &inner, head == I("let*"));
+        return St_Cons(head, St_Cons(bindings, rename_body(rc, rest, inner)));
+    }
+
+    if (head == I("letrec") || head == I("letrec*"))
+    {
+        ST_FOREACH(p, a) {
+            if (ST_PAIRP(ST_CAR(p)))
+            {
+                bind(rc, ST_CAAR(p), &inner);
+            }
+        }
+        StObject bindings = rename_each(rc, a, inner);
+        return St_Cons(head, St_Cons(bindings, rename_body(rc, rest, inner)));
+    }
+
+    if (head == I("do"))
+    {
+        // the inits are outside the scope of the vars, the steps inside
+        StObject h = Nil, t = Nil;
+        ST_FOREACH(p, a) {
+            if (ST_PAIRP(ST_CAR(p)))
+            {
+                bind(rc, ST_CAAR(p), &inner);
+            }
+        }
+        ST_FOREACH(p, a) {
+            StObject b = ST_CAR(p);
+            if (ST_PAIRP(b) && ST_PAIRP(ST_CDR(b)))
+            {
+                StObject init = rename(rc, ST_CADR(b), env);
+                ST_APPEND1(h, t, St_Cons(rename(rc, ST_CAR(b), inner),
+                                         St_Cons(init, rename_each(rc, ST_CDDR(b), inner))));
+            }
+            else
+            {
+                ST_APPEND1(h, t, rename(rc, b, inner));
+            }
+        }
+        return St_Cons(head, St_Cons(h, rename_each(rc, rest, inner)));
+    }
+
+    if (head == I("case-lambda"))
+    {
+        StObject h = Nil, t = Nil;
+        ST_FOREACH(p, ST_CDR(x)) {
+            StObject clause = ST_CAR(p);
+            if (ST_PAIRP(clause))
+            {
+                StObject clause_env = env;
+                StObject formals = bind_formals(rc, ST_CAR(clause), &clause_env);
+                ST_APPEND1(h, t, St_Cons(formals, rename_body(rc, ST_CDR(clause), clause_env)));
+            }
+            else
+            {
+                ST_APPEND1(h, t, rename(rc, clause, env));
+            }
+        }
+        return St_Cons(head, h);
+    }
+
+    if (head == I("define"))
+    {
+        StObject target = rename_define_target(rc, a, env, &inner);
+        StObject body = ST_PAIRP(a) ? rename_body(rc, rest, inner) : rename_each(rc, rest, env);
+        return St_Cons(head, St_Cons(target, body));
+    }
+
+    return rename_each(rc, x, env);
+}
+
+static Template *compile_template(RuleCompiler *rc, StObject tmpl, int depth, bool escaped)
+{
+    Template *t = St_Malloc(sizeof(Template));
+
+    if (ST_SYMBOLP(tmpl))
+    {
+        StObject v = St_Assq(tmpl, rc->vars);
+        StObject r = St_Assq(tmpl, rc->renames);
+
+        if (ST_TRUTHYP(r))
+        {
+            t->type = TMPL_VAR;
+            t->slot = ST_INT_VALUE(ST_CDR(r));
+        }
+        else if (ST_FALSEP(v))
+        {
+            t->type = TMPL_DATUM;
+            t->datum = tmpl;
+        }
+        else
+        {
+            if (ST_INT_VALUE(ST_CDDR(v)) > depth)
+            {
+                St_Error("syntax-rules: missing ellipsis after %s", ST_SYMBOL_VALUE(tmpl));
+            }
+            t->type = TMPL_VAR;
+            t->slot = ST_INT_VALUE(ST_CADR(v));
+        }
+    }
+    else if (ST_PAIRP(tmpl))
+    {
+        if (!escaped && ST_CAR(tmpl) == rc->ellipsis && ST_PAIRP(ST_CDR(tmpl)))
+        {
+            // (... template)
+            return compile_template(rc, ST_CADR(tmpl), depth, true);
+        }
+
+        int n = 0;
+        StObject rest = ST_CDR(tmpl);
+        while (!escaped && ST_PAIRP(rest) && ST_CAR(rest) == rc->ellipsis) {
+            n++;
+            rest = ST_CDR(rest);
+        }
+
+        if (n == 0)
+        {
+            t->type = TMPL_PAIR;
+            t->car = compile_template(rc, ST_CAR(tmpl), depth, escaped);
+            t->cdr = compile_template(rc, ST_CDR(tmpl), depth, escaped);
+            return t;
+        }
+
+        StObject vars = template_vars(rc, ST_CAR(tmpl), depth, Nil);
+
+        t->type = TMPL_ELLIPSIS;
+        t->depth = n;
+        t->nvars = St_Length(vars);
+        t->vars = St_Malloc(sizeof(int) * (t->nvars + 1));
+        t->var_depths = St_Malloc(sizeof(int) * (t->nvars + 1));
+
+        bool deep_enough = false;
+        int i = 0;
+        ST_FOREACH(p, vars) {
+            t->vars[i] = ST_INT_VALUE(ST_CADR(ST_CAR(p)));
+            t->var_depths[i] = ST_INT_VALUE(ST_CDDR(ST_CAR(p))) - depth;
+            deep_enough = deep_enough || t->var_depths[i] >= n;
+            i++;
+        }
+
+        if (!deep_enough)
+        {
+            St_Error("syntax-rules: too many ellipses in template");
+        }
+
+        t->car = compile_template(rc, ST_CAR(tmpl), depth + n, escaped);
+        t->cdr = compile_template(rc, rest, depth, escaped);
+    }
+    else if (ST_VECTORP(tmpl))
+    {
+        t->type = TMPL_VECTOR;
+        t->car = compile_template(rc, vector_to_list(tmpl), depth, escaped);
+    }
+    else
+    {
+        t->type = TMPL_DATUM;
+        t->datum = tmpl;
+    }
+
+    return t;
+}
+
+// (syntax-rules [ellipsis] (literal ...) (pattern template) ...)
+StObject St_MakeSyntaxRules(StObject spec)
+{
+    StObject ellipsis = I("...");
+    StObject p = ST_CDR(spec);
+
+    if (ST_PAIRP(p) && ST_SYMBOLP(ST_CAR(p)))
+    {
+        ellipsis = ST_CAR(p);
+        p = ST_CDR(p);
+    }
+
+    if (!ST_PAIRP(p) || !St_ListP(ST_CAR(p)) || !St_ListP(ST_CDR(p)))
+    {
+        St_Error("syntax-rules: malformed syntax-rules");
+    }
+
+    StObject literals = ST_CAR(p);
+    StObject rules = ST_CDR(p);
+    int nrules = St_Length(rules);
+
+    StSyntaxRules o = St_Alloc2(TEXTERNAL, sizeof(struct StSyntaxRulesRec) + sizeof(struct SyntaxRule) * nrules);
+    o->type_info = &SyntaxRulesTypeInfo;
+    o->nrules = nrules;
+
+    int i = 0;
+    ST_FOREACH(q, rules) {
+        StObject rule = ST_CAR(q);
+
+        if (St_Length(rule) != 2 || !ST_PAIRP(ST_CAR(rule)))
+        {
+            St_Error("syntax-rules: malformed rule");
+        }
+
+        RuleCompiler rc = { ellipsis, literals, Nil, 0, Nil };
+
+        // the keyword position of the pattern is ignored
+        o->rules[i].pattern = compile_pattern(&rc, ST_CDAR(rule), 0);
+        o->rules[i].nslots = rc.nslots;
+
+        StObject tmpl = rename(&rc, ST_CADR(rule), Nil);
+        o->rules[i].nrenames = rc.nslots - o->rules[i].nslots;
+
+        o->rules[i].template = compile_template(&rc, tmpl, 0, false);
+        i++;
+    }
+
+    return ST_OBJECT(o);
+}
+
+bool St_SyntaxRulesP(StObject obj)
+{
+    return ST_EXTERNALP(obj) && ST_EXTERNAL_TYPE_INFO(obj) == &SyntaxRulesTypeInfo;
+}
+
+// Matcher
+
+static bool match(Pattern *p, StObject x, StObject *slots)
+{
+    switch (p->type) {
+    case PAT_ANY:
+        return true;
+
+    case PAT_VAR:
+        slots[p->slot] = x;
+        return true;
+
+    case PAT_LITERAL:
+        return x == p->datum;
+
+    case PAT_DATUM:
+        return St_EqualP(x, p->datum);
+
+    case PAT_NIL:
+        return ST_NULLP(x);
+
+    case PAT_PAIR:
+        return ST_PAIRP(x)
+            && match(p->car, ST_CAR(x), slots)
+            && match(p->cdr, ST_CDR(x), slots);
+
+    case PAT_VECTOR:
+        return ST_VECTORP(x) && match(p->car, vector_to_list(x), slots);
+
+    case PAT_ELLIPSIS: {
+        int len = 0;
+        for (StObject q = x; ST_PAIRP(q); q = ST_CDR(q)) {
+            len++;
+        }
+
+        int n = len - p->min_len;
+        if (n < 0)
+        {
+            return false;
+        }
+
+        StObject seqs[p->nvars + 1];
+        for (int j = 0; j < p->nvars; j++) {
+            seqs[j] = Nil;
+        }
+
+        for (int i = 0; i < n; i++, x = ST_CDR(x)) {
+            if (!match(p->car, ST_CAR(x), slots))
+            {
+                return false;
+            }
+            for (int j = 0; j < p->nvars; j++) {
+                seqs[j] = St_Cons(slots[p->vars[j]], seqs[j]);
+            }
+        }
+
+        for (int j = 0; j < p->nvars; j++) {
+            slots[p->vars[j]] = St_Reverse(seqs[j]);
+        }
+
+        return match(p->cdr, x, slots);
+    }
+    }
+
+    return false;
+}
+
+// Instantiator
+
+static StObject instantiate(Template *t, StObject *slots);
+
+static void instantiate_ellipsis(Template *t, StObject *slots, int level, StObject *head, StObject *tail)
+{
+    StObject saved[t->nvars + 1];
+    StObject seqs[t->nvars + 1];
+
+    for (int i = 0; i < t->nvars; i++) {
+        saved[i] = seqs[i] = slots[t->vars[i]];
+    }
+
+    while (true)
+    {
+        int iterated = 0, remaining = 0;
+
+        for (int i = 0; i < t->nvars; i++) {
+            if (t->var_depths[i] >= level)
+            {
+                iterated++;
+                if (ST_PAIRP(seqs[i]))
+                {
+                    remaining++;
+                }
+            }
+        }
+
+        if (remaining == 0)
+        {
+            break;
+        }
+
+        if (remaining != iterated)
+        {
+            St_Error("syntax-rules: pattern variables matched sequences of different lengths");
+        }
+
+        for (int i = 0; i < t->nvars; i++) {
+            if (t->var_depths[i] >= level)
+            {
+                slots[t->vars[i]] = ST_CAR(seqs[i]);
+                seqs[i] = ST_CDR(seqs[i]);
+            }
+        }
+
+        if (level == t->depth)
+        {
+            ST_APPEND1(*head, *tail, instantiate(t->car, slots));
+        }
+        else
+        {
+            instantiate_ellipsis(t, slots, level + 1, head, tail);
+        }
+    }
+
+    for (int i = 0; i < t->nvars; i++) {
+        slots[t->vars[i]] = saved[i];
+    }
+}
+
+static StObject instantiate(Template *t, StObject *slots)
+{
+    switch (t->type) {
+    case TMPL_DATUM:
+        return t->datum;
+
+    case TMPL_VAR:
+        return slots[t->slot];
+
+    case TMPL_PAIR:
+        return St_Cons(instantiate(t->car, slots), instantiate(t->cdr, slots));
+
+    case TMPL_ELLIPSIS: {
+        StObject head = Nil, tail = Nil;
+        instantiate_ellipsis(t, slots, 1, &head, &tail);
+
+        StObject rest = instantiate(t->cdr, slots);
+        if (ST_NULLP(head))
+        {
+            return rest;
+        }
+        ST_CDR_SET(tail, rest);
+        return head;
+    }
+
+    case TMPL_VECTOR:
+        return St_MakeVectorFromList(instantiate(t->car, slots));
+    }
+
+    return Nil;
+}
+
+StObject St_SyntaxRulesExpand(StObject rules, StObject form)
+{
+    StSyntaxRules o = ST_SYNTAX_RULES(rules);
+
+    for (int i = 0; i < o->nrules; i++) {
+        struct SyntaxRule *r = &o->rules[i];
+        StObject slots[r->nslots + r->nrenames + 1];
+
+        if (match(r->pattern, ST_CDR(form), slots))
+        {
+            for (int j = 0; j < r->nrenames; j++) {
+                slots[r->nslots + j] = St_Gensym();
+            }
+            return instantiate(r->template, slots);
+        }
+    }
+
+    St_Error("%s: no matching syntax rule", ST_SYMBOL_VALUE(ST_CAR(form)));
+}
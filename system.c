@@ -73,11 +73,14 @@ StObject St_SysPipe(void)
         St_Error("pipe error");
     }
 
-    return St_Cons(St_MakeFdPort(fds[0], true), St_MakeFdPort(fds[1], true));
+    return St_Values2(St_MakeFdPort(fds[0], true), St_MakeFdPort(fds[1], true));
 }
 
 int St_SysFork(void)
 {
+    // or the child would write the buffered output again
+    St_FlushAllPorts();
+
     int pid = fork();
     if (pid == -1)
     {
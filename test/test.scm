@@ -383,3 +383,332 @@
 
 (assert 4 (arithmetic-shift 1 2) 'arithmetic-shift_0)
 (assert 5 (arithmetic-shift 20 -2) 'arithmetic-shift_1)
+
+(define const-a 1)
+(define (get-const-a) const-a)
+(assert 1 (get-const-a) 'global-constant_0)
+(define const-a 2)
+(assert 2 (get-const-a) 'global-constant_1)
+(set! const-a 3)
+(assert 3 (get-const-a) 'global-constant_2)
+
+(define (inline-sq x) (* x x))
+(define (inline-user y) (+ (inline-sq y) (inline-sq (+ y 1))))
+(assert 25 (inline-user 3) 'inline_0)
+(define (inline-sq x) (+ x x))
+(assert 14 (inline-user 3) 'inline_1)
+(define (inline-shadow inline-sq) (inline-user inline-sq))
+(assert 14 (inline-shadow 3) 'inline_2)
+(define inline-k 5)
+(define (inline-getk) inline-k)
+(define (inline-usek) (inline-getk))
+(define inline-u inline-usek)
+(assert 5 (inline-u) 'inline_3)
+(define (inline-getk) 100)
+(assert 100 (inline-u) 'inline_4)
+(define inline-k 7)
+(assert 100 (inline-u) 'inline_5)
+(define (inline-getk) inline-k)
+(assert 7 (inline-u) 'inline_6)
+
+(define (let-closure a)
+  (let ((lx a) (ly (+ a 1)))
+    (set! lx (* lx 10))
+    (lambda () (list lx ly a))))
+(assert '(50 6 5) ((let-closure 5)) 'let_3)
+(assert '(2 1) (let ((a 1) (b 2)) (let ((a b) (b a)) (list a b))) 'let_4)
+
+(define (lift-sum a n)
+  (define (loop i acc) (if (= i 0) acc (loop (- i 1) (+ acc a))))
+  (define (start) (loop n 0))
+  (start))
+(assert 12 (lift-sum 3 4) 'lambda-lifting_0)
+(define (lift-assigned n)
+  (define (get) n)
+  (set! n (+ n 1))
+  (get))
+(assert 2 (lift-assigned 1) 'lambda-lifting_1)
+(define (lift-shadowed n)
+  (define (get) n)
+  ((lambda (n) (get)) 10))
+(assert 1 (lift-shadowed 1) 'lambda-lifting_2)
+
+(define (known-count n) (if (= n 0) 'done (known-count (- n 1))))
+(define (known-caller) (known-count 3))
+(assert 'done (known-caller) 'call-known_0)
+(define (known-count n) n)
+(assert 3 (known-caller) 'call-known_1)
+
+(define-syntax sr-or
+  (syntax-rules ()
+    ((_) #f)
+    ((_ e) e)
+    ((_ e r ...) (let ((t e)) (if t t (sr-or r ...))))))
+(assert 3 (sr-or #f #f 3) 'syntax-rules_0)
+(define-syntax sr-flatten
+  (syntax-rules ()
+    ((_ (a ...) ...) '(a ... ...))))
+(assert '(1 2 3 4) (sr-flatten (1 2) () (3 4)) 'syntax-rules_1)
+(define-syntax sr-arrow
+  (syntax-rules (=>)
+    ((_ a => b) (list a b))
+    ((_ a b) 'no-arrow)))
+(assert '(1 2) (sr-arrow 1 => 2) 'syntax-rules_2)
+(assert 'no-arrow (sr-arrow 1 2) 'syntax-rules_3)
+(define-syntax my-or (syntax-rules () ((_ a b) (let ((t a)) (if t t b)))))
+(define t 5)
+(assert 5 (my-or #f t) 'syntax-rules_4)
+(define-syntax sr-swap! (syntax-rules () ((_ a b) (let ((tmp a)) (set! a b) (set! b tmp)))))
+(define tmp 1)
+(define sr-other 2)
+(sr-swap! tmp sr-other)
+(assert '(2 1) (list tmp sr-other) 'syntax-rules_5)
+(define-syntax sr-quoted (syntax-rules () ((_ x) (let ((t x)) (list 't t)))))
+(assert '(t 4) (sr-quoted 4) 'syntax-rules_6)
+(define sr-x 100)
+(define-syntax sr-scoped (syntax-rules () ((_ e) (list (let ((sr-x e)) sr-x) sr-x))))
+(assert '(1 100) (sr-scoped 1) 'syntax-rules_7)
+(define-syntax sr-define-foo (syntax-rules () ((_ v) (begin (define sr-foo v) (define (sr-foo-plus y) (+ y sr-foo))))))
+(sr-define-foo 42)
+(assert 42 sr-foo 'syntax-rules_8)
+(assert 43 (sr-foo-plus 1) 'syntax-rules_9)
+(define-syntax sr-internal (syntax-rules () ((_ v) ((lambda () (define sr-h 10) (+ sr-h v))))))
+(define sr-h 1)
+(assert 11 (sr-internal sr-h) 'syntax-rules_10)
+
+(assert '(let ((a 1)) a) '(let ((a 1)) a) 'expand_0)
+(define ((expand-curried a) b) (list a b))
+(assert '(1 2) ((expand-curried 1) 2) 'expand_1)
+
+(define shadowed-global 10)
+(define (shadowing-closure shadowed-global) (lambda () shadowed-global))
+(assert 5 ((shadowing-closure 5)) 'free-variable_0)
+
+(define (case-dense x) (case x ((1 2) 'low) ((3 4 5) 'mid) (else 'other)))
+(assert 'mid (case-dense 4) 'case-table_0)
+(assert 'other (case-dense 9) 'case-table_1)
+(define (case-sparse x) (case x ((a b) 'ab) ((c 1000) 'c) (else 'other)))
+(assert 'c (case-sparse 1000) 'case-hash_0)
+(assert 'other (case-sparse 'z) 'case-hash_1)
+
+(define (match-eval x)
+  (match x
+    (('add a b) (+ (match-eval a) (match-eval b)))
+    (('neg a) (- 0 (match-eval a)))
+    ((? integer? n) n)
+    (_ 'error)))
+(assert 3 (match-eval '(add 5 (neg 2))) 'match_0)
+(assert 'error (match-eval '(mul 1 2)) 'match_1)
+(assert '(1 (2 3)) (match '(1 2 3) ((a . (and rest (_ _))) (list a rest))) 'match_2)
+
+(define case-lambda-area
+  (case-lambda
+    ((r) (* 3 r r))
+    ((w h) (* w h))
+    ((a b . more) more)))
+(assert 12 (case-lambda-area 2) 'case-lambda_0)
+(assert 10 (case-lambda-area 2 5) 'case-lambda_1)
+(assert '(3 4) (case-lambda-area 1 2 3 4) 'case-lambda_2)
+(define-optional (optional-args a (b 10) (c (+ b 1)) . rest) (list a b c rest))
+(assert '(1 10 11 ()) (optional-args 1) 'define-optional_0)
+(assert '(1 2 3 (4)) (optional-args 1 2 3 4) 'define-optional_1)
+
+(define (values-divmod a b) (values (/ a b) (- a (* b (/ a b)))))
+(assert '(3 2) (receive (q r) (values-divmod 17 5) (list q r)) 'values_0)
+(assert '(1 (2 3)) (receive (a . rest) (values 1 2 3) (list a rest)) 'values_1)
+(assert '(1 2 3) (call-with-values (lambda () (values 1 2 3)) list) 'values_2)
+(assert '(2 1 1) (let ((a 1) (b 2)) (let-values (((a b) (values b a)) ((c) (values a))) (list a b c))) 'let-values_0)
+(assert '(1 2 3) (let*-values (((a b) (values 1 2)) ((c) (values (+ a b)))) (list a b c)) 'let-values_1)
+(assert '(1) (list (values 1 2)) 'values_3)
+(define values-x (values 1 2))
+(values 7 8 9)
+(assert '(1) (call-with-values (lambda () values-x) list) 'values_4)
+(assert 'no (if (values #f #t) 'yes 'no) 'values_5)
+
+(define (escape-find pred lst)
+  (call/cc (lambda (return)
+    (define (loop l) (if (null? l) #f (if (pred (car l)) (return (car l)) (loop (cdr l)))))
+    (loop lst))))
+(assert 4 (escape-find even? '(1 3 4 5)) 'call/ec_0)
+(assert 1 (let/ec outer (+ 100 (let/ec inner (outer 1)))) 'call/ec_1)
+(assert 101 (call/ec (lambda (outer) (+ 100 (let/ec inner (inner 1))))) 'call/ec_2)
+(assert 5 (call/ec (lambda (k) (apply k '(5)))) 'call/ec_3)
+(assert '(caught x) (guard (e (#t (list 'caught e))) (raise 'x)) 'call/ec_4)
+(define escape-saved #f)
+(call/ec (lambda (k) (set! escape-saved k)))
+(assert "escape procedure called outside of its extent" (guard (e ((error-object? e) (error-object-message e))) (apply escape-saved '(2))) 'call/ec_5)
+
+(assert '(caught boom) (guard (e (#t (list 'caught e))) (raise 'boom)) 'guard_0)
+(assert '("bad" (1 2)) (guard (e ((error-object? e) (list (error-object-message e) (error-object-irritants e)))) (error "bad" 1 2)) 'guard_1)
+(assert "car: pair required" (guard (e ((error-object? e) (error-object-message e))) (car 1)) 'guard_2)
+(assert 'outer (guard (e ((symbol? e) 'outer)) (guard (e ((number? e) 'inner)) (raise 'x))) 'guard_3)
+(assert 41 (with-exception-handler (lambda (c) (* c 10)) (lambda () (+ 1 (raise-continuable 4)))) 'with-exception-handler_0)
+
+(define wind-trace '())
+(define (wind-note x) (set! wind-trace (cons x wind-trace)))
+(assert 42 (dynamic-wind (lambda () (wind-note 'in)) (lambda () 42) (lambda () (wind-note 'out))) 'dynamic-wind_0)
+(assert 1 (let/ec k (dynamic-wind (lambda () (wind-note 'in)) (lambda () (k 1) 2) (lambda () (wind-note 'out)))) 'dynamic-wind_1)
+(assert '(out in out in) wind-trace 'dynamic-wind_2)
+(define param-a (make-parameter 10))
+(define param-b (make-parameter 5 (lambda (x) (* x 2))))
+(assert '(1 6 10 10) (append (parameterize ((param-a 1) (param-b 3)) (list (param-a) (param-b))) (list (param-a) (param-b))) 'parameterize_0)
+(assert '(oops 10) (guard (e (#t (list e (param-a)))) (parameterize ((param-a 2)) (raise 'oops))) 'parameterize_1)
+(assert '(3 10) (list (let/ec k (parameterize ((param-a 3)) (k (param-a)))) (param-a)) 'parameterize_2)
+
+(define (limits-loop n) (limits-loop (+ n 1)))
+(assert 3 (eval-with-limits '(+ 1 2) :fuel 10) 'eval-with-limits_0)
+(assert '(:fuel :fuel) (list :fuel ':fuel) 'keyword_0)
+(assert "eval-with-limits: fuel exceeded" (guard (e ((error-object? e) (error-object-message e))) (eval-with-limits '(limits-loop 0) :fuel 1000)) 'eval-with-limits_1)
+(assert "eval-with-limits: fuel exceeded" (guard (e ((error-object? e) (error-object-message e))) (eval-with-limits '(guard (e (#t 'swallowed)) (limits-loop 0)) :fuel 1000 :timeout-ms 1000)) 'eval-with-limits_2)
+(assert "spawn: can not spawn a thread in eval-with-limits" (guard (e ((error-object? e) (error-object-message e))) (eval-with-limits '(begin (spawn (lambda () (limits-loop 0))) 'spawned) :fuel 100)) 'eval-with-limits_3)
+(define limits-wound '())
+(assert '("eval-with-limits: fuel exceeded" (before) 10) (let* ((message (guard (e ((error-object? e) (error-object-message e))) (eval-with-limits '(parameterize ((param-a 1)) (dynamic-wind (lambda () (set! limits-wound (cons 'before limits-wound))) (lambda () (limits-loop 0)) (lambda () (set! limits-wound (cons 'after limits-wound))))) :fuel 1000)))) (list message limits-wound (param-a))) 'eval-with-limits_4)
+
+(define (thread-count n acc) (if (= n 0) acc (thread-count (- n 1) (+ acc 1))))
+(define thread-log '())
+(define (thread-worker name k) (if (= k 0) name (begin (set! thread-log (cons name thread-log)) (yield) (thread-worker name (- k 1)))))
+(assert '(5000 3000) (let ((a (spawn (lambda () (thread-count 5000 0)))) (b (spawn (lambda () (thread-count 3000 0))))) (list (thread-join a) (thread-join b))) 'thread_0)
+(assert '(y x y x) (let ((a (spawn (lambda () (thread-worker 'x 2)))) (b (spawn (lambda () (thread-worker 'y 2))))) (thread-join a) (thread-join b) thread-log) 'thread_1)
+(assert '(caught oops) (guard (e (#t (list 'caught e))) (thread-join (spawn (lambda () (raise 'oops))))) 'thread_2)
+(assert "hello" (receive (in out) (sys-pipe) (let ((reader (spawn (lambda () (read-line in))))) (yield) (display "hello" out) (newline out) (thread-join reader))) 'thread_3)
+(define (thread-read-split rd before after)
+  (receive (in out) (sys-pipe)
+    (display before out) (flush-output-port out)
+    (let ((reader (spawn (lambda () (rd in)))))
+      (yield)
+      (display after out) (flush-output-port out)
+      (thread-join reader))))
+(assert "hello" (thread-read-split read-line "hel" "lo\n") 'thread_4)
+(assert '(a (b c)) (thread-read-split read "(a (b" " c)) ") 'thread_5)
+(assert "abcdef" (thread-read-split (lambda (in) (read-string 6 in)) "abc" "def") 'thread_6)
+(define thread-line #f)
+(define (thread-spin) (if (not thread-line) (begin (yield) (thread-spin))))
+(assert "ready" (receive (in out) (sys-pipe) (let ((reader (spawn (lambda () (set! thread-line (read-line in)))))) (yield) (display "ready" out) (newline out) (thread-spin) thread-line)) 'thread_7)
+(define (thread-deep n) (if (= n 0) 0 (+ 1 (thread-deep (- n 1)))))
+(assert 1000 (thread-join (spawn (lambda () (thread-deep 1000)))) 'thread_8)
+(assert 50000 (thread-deep 50000) 'thread_9)
+(define (thread-runaway n) (+ 1 (thread-runaway n)))
+(assert "stack overflow" (guard (e ((error-object? e) (error-object-message e))) (thread-join (spawn (lambda () (thread-runaway 0))))) 'thread_10)
+
+(define event-log '())
+(define (event-note x) (set! event-log (cons x event-log)))
+(set-timer 20 (lambda () (event-note 'late)))
+(set-timer 0 (lambda () (event-note 'early)))
+(cancel-event (set-timer 10 (lambda () (event-note 'cancelled))))
+(event-loop-run)
+(assert '(late early) event-log 'event-loop_0)
+(define event-lines '())
+(receive (in out)
+    (sys-pipe)
+  (define reader #f)
+  (set! reader (on-readable in (lambda (p) (let1 line (read-line p) (set! event-lines (cons line event-lines)) (if (equal? line "b") (cancel-event reader))))))
+  (display "a\nb\n" out)
+  (event-loop-run))
+(assert '("b" "a") event-lines 'event-loop_1)
+(define event-reused '())
+(receive (in out)
+    (sys-pipe)
+  ;; the new pipe takes the fds of the closed one
+  (on-readable in (lambda (p)
+                    (set! event-reused (cons (read-line p) event-reused))
+                    (close-port p)
+                    (close-port out)
+                    (receive (in2 out2)
+                        (sys-pipe)
+                      (on-readable in2 (lambda (p2) (set! event-reused (cons (read-line p2) event-reused)) (close-port p2) (close-port out2)))
+                      (display "second\n" out2))))
+  (display "first\n" out)
+  (event-loop-run))
+(assert '("second" "first") event-reused 'event-loop_2)
+
+(define file-port-path "/tmp/lisp-test-file-port.txt")
+(let1 out (open-output-file file-port-path)
+  (define (write-lines i) (if (< i 3000) (begin (display i out) (newline out) (write-lines (+ i 1)))))
+  (write-lines 0)
+  (close-port out))
+(define file-port-in (open-input-file file-port-path))
+(define (read-lines n last) (let1 line (read-line file-port-in) (if (equal? line "") (cons n last) (read-lines (+ n 1) line))))
+(assert '(3000 . "2999") (read-lines 0 #f) 'file-port_0)
+(assert #t (eof-object? (read-char file-port-in)) 'file-port_1)
+(close-port file-port-in)
+
+(define buffered-out (open-output-file file-port-path))
+(assert 'full (port-buffering buffered-out) 'port-buffering_0)
+(close-port buffered-out)
+(receive (in out) (sys-pipe)
+  (set-port-buffering! out 'full)
+  (display "buffered\n" out)
+  (assert #f (u8-ready? in) 'port-buffering_1)
+  (flush-output-port out)
+  (assert "buffered" (read-line in) 'port-buffering_2)
+  (set-port-buffering! out 'none)
+  (assert 'none (port-buffering out) 'port-buffering_3)
+  (display "unbuffered" out)
+  (assert "unbuffered" (read-string 10 in) 'port-buffering_4)
+  (close-port out))
+
+(define bulk-path "/tmp/lisp-test-bulk.txt")
+(let1 out (open-output-file bulk-path)
+  (display (make-string 15000) out)
+  (display "\nshort\n" out)
+  (close-port out))
+(define bulk-in (open-input-file bulk-path))
+(assert 15000 (string-length (read-line bulk-in)) 'read-line_0)
+(assert "short" (read-line bulk-in) 'read-line_1)
+(assert #t (eof-object? (read-string 3 bulk-in)) 'read-string_0)
+(close-port bulk-in)
+(receive (in out) (sys-pipe)
+  (display "hello world" out)
+  (close-port out)
+  (assert "hello" (read-string 5 in) 'read-string_1)
+  (assert " world" (read-string 100 in) 'read-string_2))
+(define bulk-in (open-input-file bulk-path))
+(define bulk-bv (make-bytevector 15001 0))
+(assert 15001 (read-bytevector! bulk-bv bulk-in) 'read-bytevector_0)
+(assert 10 (bytevector-u8-ref bulk-bv 15000) 'read-bytevector_1)
+(assert (bytevector 115 104 111 114 116 10) (read-bytevector 10 bulk-in) 'read-bytevector_2)
+(assert #t (eof-object? (read-bytevector! bulk-bv bulk-in)) 'read-bytevector_3)
+(close-port bulk-in)
+
+(define mapped-in (open-input-file bulk-path :mmap #t))
+(assert 15000 (string-length (read-line mapped-in)) 'mmap-port_0)
+(assert "short" (read-line mapped-in) 'mmap-port_1)
+(assert #t (eof-object? (read-char mapped-in)) 'mmap-port_2)
+(close-port mapped-in)
+(define mapped-bv (file->bytevector bulk-path))
+(assert 15007 (bytevector-length mapped-bv) 'file->bytevector_0)
+(assert 115 (bytevector-u8-ref mapped-bv 15001) 'file->bytevector_1)
+(assert "bytevector-u8-set!: bytevector is read-only" (guard (e (#t (error-object-message e))) (bytevector-u8-set! mapped-bv 0 1)) 'file->bytevector_2)
+
+(assert '(1 "two" (3)) (read (open-input-string "(1 \"two\" (3)) rest")) 'string-port_0)
+(let1 in (open-input-string "ab\ncd")
+  (assert "ab" (read-line in) 'string-port_1)
+  (assert "cd" (read-string 10 in) 'string-port_2))
+(let1 out (open-output-string)
+  (display "x = " out)
+  (display '(1 2) out)
+  (assert "x = (1 2)" (get-output-string out) 'string-port_3))
+(let1 out (open-output-bytevector)
+  (write-u8 1 out)
+  (write-u8 255 out)
+  (assert (bytevector 1 255) (get-output-bytevector out) 'bytevector-port_0))
+(assert 7 (read-u8 (open-input-bytevector (bytevector 7 8))) 'bytevector-port_1)
+
+(define long-literal (make-string 6000))
+(assert 6000 (string-length (read (open-input-string (string-append "\"" long-literal "\"")))) 'reader_0)
+(define (repeat-string s n out) (if (= n 0) (get-output-string out) (begin (display s out) (repeat-string s (- n 1) out))))
+(assert 6000 (string-length (symbol->string (read (open-input-string (repeat-string "ab" 3000 (open-output-string)))))) 'reader_1)
+(assert "a\"b\\c\nd" (read (open-input-string "   \n  \"a\\\"b\\\\c\\nd\"")) 'reader_2)
+(assert '(x . 1) (read (open-input-string "; comment\n(x . 1)")) 'reader_3)
+
+(define inc-reader (make-incremental-reader))
+(reader-feed! inc-reader "(1 (2 \"a)")
+(assert #t (need-more? (reader-read inc-reader)) 'incremental-reader_0)
+(reader-feed! inc-reader "\") 3) foo")
+(assert '(1 (2 "a)") 3) (reader-read inc-reader) 'incremental-reader_1)
+(assert #t (need-more? (reader-read inc-reader)) 'incremental-reader_2)
+(reader-feed! inc-reader "bar #u8(1 2) ; done\n")
+(assert 'foobar (reader-read inc-reader) 'incremental-reader_3)
+(assert (bytevector 1 2) (reader-read inc-reader) 'incremental-reader_4)
+(reader-feed! inc-reader (eof-object))
+(assert #t (eof-object? (reader-read inc-reader)) 'incremental-reader_5)
@@ -0,0 +1,445 @@
+#ifdef ST_USE_IO_URING
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "lisp.h"
+
+// io_uring backend of file ports
+//
+// Ports opened by open-input-file and open-output-file do their I/O
+// through one io_uring shared by the process when it is available. An
+// input port has a second buffer which the next read is issued into as
+// soon as the current one is handed out (read-ahead). An output port
+// collects writes into a buffer and issues it when it is full
+// (write-behind), so the program does not wait for the write itself.
+//
+// Requests are submitted in batches: when URING_BATCH of them are queued,
+// or when a port has to wait for its own. Completions are reaped whenever
+// a port using the ring is touched; an error of a write behind is
+// reported by the next operation on its port. Flushing a port, which
+// port.c does on close and at exit, waits for its writes.
+//
+// The ring is driven with the raw system calls so that liburing is not
+// needed.
+
+#define URING_ENTRIES 64
+#define URING_BATCH   8
+#define BUFSIZE       ST_FDPORT_BUFSIZE
+
+struct StUringOpRec
+{
+    struct StUringOpRec *next;
+    struct StUringPortRec *port;
+    uint8_t *buf;
+    size_t len;
+    off_t offset;
+    bool done;
+    int res;
+};
+typedef struct StUringOpRec *StUringOp;
+
+struct StUringPortRec
+{
+    struct StUringPortRec *next; // in AllPorts
+    int fd;
+    bool output;
+    off_t offset;    // of the next read or write issued
+    StUringOp ahead; // read in flight, if any
+    StUringOp writes; // writes in flight
+    uint8_t *wbuf;
+    size_t wlen;
+    int error;       // errno of a failed write behind
+};
+typedef struct StUringPortRec *StUringPort;
+
+static int Ring = -1;
+static bool Unavailable;
+static unsigned Entries;
+static unsigned *SqHead, *SqTail, *SqMask, *SqArray;
+static unsigned *CqHead, *CqTail, *CqMask;
+static struct io_uring_sqe *Sqes;
+static struct io_uring_cqe *Cqes;
+static unsigned Queued; // sqes not submitted yet
+
+// keeps the buffers of requests in flight alive until they complete
+static StUringPort AllPorts;
+
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, Ring, to_submit, min_complete, flags, NULL, 0);
+}
+
+static bool setup(void)
+{
+    if (Ring != -1 || Unavailable)
+    {
+        return Ring != -1;
+    }
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = uring_setup(URING_ENTRIES, &p);
+    if (fd == -1)
+    {
+        Unavailable = true;
+        return false;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+
+    if (single && cq_size > sq_size)
+    {
+        sq_size = cq_size;
+    }
+
+    char *sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    char *cq = single ? sq : mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void *sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        close(fd);
+        Unavailable = true;
+        return false;
+    }
+
+    Ring = fd;
+    Entries = p.sq_entries;
+    SqHead = (unsigned *)(sq + p.sq_off.head);
+    SqTail = (unsigned *)(sq + p.sq_off.tail);
+    SqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+    SqArray = (unsigned *)(sq + p.sq_off.array);
+    CqHead = (unsigned *)(cq + p.cq_off.head);
+    CqTail = (unsigned *)(cq + p.cq_off.tail);
+    CqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+    Sqes = sqes;
+    Cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return true;
+}
+
+static void enter(unsigned min_complete)
+{
+    unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+    while (Queued > 0 || min_complete > 0)
+    {
+        int n = uring_enter(Queued, min_complete, flags);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            St_Error("io_uring_enter failed");
+        }
+        Queued -= n;
+        min_complete = 0;
+        flags = 0;
+    }
+}
+
+static void issue(StUringOp op);
+
+static void remove_write(StUringPort u, StUringOp op)
+{
+    for (StUringOp *p = &u->writes; *p != NULL; p = &(*p)->next) {
+        if (*p == op)
+        {
+            *p = op->next;
+            return;
+        }
+    }
+}
+
+static void complete(StUringOp op)
+{
+    StUringPort u = op->port;
+
+    if (!u->output)
+    {
+        return; // the reader picks it up from u->ahead
+    }
+
+    remove_write(u, op);
+
+    if (op->res < 0)
+    {
+        u->error = -op->res;
+    }
+    else if ((size_t)op->res < op->len)
+    {
+        // the rest of a short write is issued again
+        op->buf += op->res;
+        op->len -= op->res;
+        op->offset += op->res;
+        op->done = false;
+        op->next = u->writes;
+        u->writes = op;
+        issue(op);
+    }
+}
+
+static void reap(void)
+{
+    unsigned head = *CqHead;
+
+    while (head != __atomic_load_n(CqTail, __ATOMIC_ACQUIRE))
+    {
+        struct io_uring_cqe *cqe = &Cqes[head & *CqMask];
+        StUringOp op = (StUringOp)(uintptr_t)cqe->user_data;
+
+        op->res = cqe->res;
+        op->done = true;
+        head++;
+        __atomic_store_n(CqHead, head, __ATOMIC_RELEASE);
+
+        complete(op);
+    }
+}
+
+static struct io_uring_sqe *get_sqe(void)
+{
+    while (*SqTail - __atomic_load_n(SqHead, __ATOMIC_ACQUIRE) >= Entries)
+    {
+        enter(Queued > 0 ? 0 : 1);
+        reap();
+    }
+
+    unsigned tail = *SqTail;
+    unsigned index = tail & *SqMask;
+    struct io_uring_sqe *sqe = &Sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    SqArray[index] = index;
+
+    return sqe;
+}
+
+static void issue(StUringOp op)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+
+    sqe->opcode = op->port->output ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = op->port->fd;
+    sqe->addr = (uintptr_t)op->buf;
+    sqe->len = op->len;
+    sqe->off = op->offset;
+    sqe->user_data = (uintptr_t)op;
+
+    __atomic_store_n(SqTail, *SqTail + 1, __ATOMIC_RELEASE);
+    Queued++;
+
+    if (Queued >= URING_BATCH)
+    {
+        enter(0);
+    }
+}
+
+static StUringOp make_op(StUringPort u, uint8_t *buf, size_t len)
+{
+    StUringOp op = St_Malloc(sizeof(struct StUringOpRec));
+
+    op->next = NULL;
+    op->port = u;
+    op->buf = buf;
+    op->len = len;
+    op->offset = u->offset;
+    op->done = false;
+    op->res = 0;
+
+    u->offset += len;
+
+    return op;
+}
+
+static void wait_op(StUringOp op)
+{
+    reap();
+    while (!op->done)
+    {
+        enter(1);
+        reap();
+    }
+}
+
+bool St_UringAttach(StObject port, bool output)
+{
+    if (!setup())
+    {
+        return false;
+    }
+
+    StUringPort u = St_Malloc(sizeof(struct StUringPortRec));
+
+    u->fd = ST_FDPORT_FD(port);
+    u->output = output;
+    u->offset = 0;
+    u->ahead = NULL;
+    u->writes = NULL;
+    u->wbuf = output ? St_Malloc(BUFSIZE) : NULL;
+    u->wlen = 0;
+    u->error = 0;
+
+    u->next = AllPorts;
+    AllPorts = u;
+
+    ST_FDPORT(port)->uring = u;
+
+    return true;
+}
+
+// fills the buffer of the port with the next read and issues the one after
+ssize_t St_UringRead(StObject port)
+{
+    StUringPort u = ST_FDPORT(port)->uring;
+    StUringOp op = u->ahead;
+
+    if (op == NULL)
+    {
+        op = make_op(u, ST_FDPORT(port)->buf, BUFSIZE);
+        issue(op);
+    }
+
+    wait_op(op);
+    u->ahead = NULL;
+
+    if (op->res < 0)
+    {
+        errno = -op->res;
+        return -1;
+    }
+
+    // the buffer which was handed out last is free now
+    uint8_t *spare = ST_FDPORT(port)->buf;
+    ST_FDPORT(port)->buf = op->buf;
+
+    // a read past the end of file has nothing to read ahead of
+    if (op->res > 0)
+    {
+        if (spare == op->buf)
+        {
+            spare = St_Malloc(BUFSIZE);
+        }
+        u->offset -= op->len - op->res;
+        u->ahead = make_op(u, spare, BUFSIZE);
+        issue(u->ahead);
+    }
+
+    return op->res;
+}
+
+static void check_error(StUringPort u)
+{
+    reap();
+
+    if (u->error != 0)
+    {
+        errno = u->error;
+        u->error = 0;
+        St_Error("write error");
+    }
+}
+
+static void write_behind(StUringPort u)
+{
+    if (u->wlen == 0)
+    {
+        return;
+    }
+
+    StUringOp op = make_op(u, u->wbuf, u->wlen);
+    op->next = u->writes;
+    u->writes = op;
+    issue(op);
+
+    u->wbuf = St_Malloc(BUFSIZE);
+    u->wlen = 0;
+}
+
+void St_UringWrite(StObject port, const char *buf, size_t len)
+{
+    StUringPort u = ST_FDPORT(port)->uring;
+
+    check_error(u);
+
+    while (len > 0)
+    {
+        size_t n = BUFSIZE - u->wlen;
+        if (n > len)
+        {
+            n = len;
+        }
+
+        memcpy(u->wbuf + u->wlen, buf, n);
+        u->wlen += n;
+        buf += n;
+        len -= n;
+
+        if (u->wlen == BUFSIZE)
+        {
+            write_behind(u);
+        }
+    }
+}
+
+// waits until every write of the port is done
+static void flush(StUringPort u)
+{
+    write_behind(u);
+    enter(0);
+
+    while (u->writes != NULL)
+    {
+        wait_op(u->writes);
+    }
+}
+
+void St_UringFlush(StObject port)
+{
+    StUringPort u = ST_FDPORT(port)->uring;
+
+    flush(u);
+    check_error(u);
+}
+
+// waits for the requests of the port before its fd is closed
+void St_UringDetach(StObject port)
+{
+    StUringPort u = ST_FDPORT(port)->uring;
+
+    if (u->output)
+    {
+        flush(u);
+    }
+    else if (u->ahead != NULL)
+    {
+        enter(0);
+        wait_op(u->ahead);
+    }
+
+    for (StUringPort *p = &AllPorts; *p != NULL; p = &(*p)->next) {
+        if (*p == u)
+        {
+            *p = u->next;
+            break;
+        }
+    }
+
+    ST_FDPORT(port)->uring = NULL;
+}
+
+#endif
@@ -1,4 +1,8 @@
+#include <errno.h>
+#include <poll.h>
+#include <setjmp.h>
 #include <stdio.h>
+#include <time.h>
 #include "lisp.h"
 #include "subr.h"
 
@@ -14,6 +18,13 @@ typedef struct STVm
     StObject c; // Current closure
     int s;     // Current stack
     StObject m; // Current module
+    StObject values; // Multiple values returned with MultipleValues
+    int nvalues;
+    int handler; // Innermost handler record, or -1
+    StObject raised; // Object being raised
+    bool continuable;
+    StObject winders; // Entries of dynamic-wind and parameterize, innermost first
+    long ticks; // Calls left until the next safepoint
 
     // first argument               pushed by `argument`
     // ...                          ...
@@ -28,6 +39,61 @@ typedef struct STVm
 static STVm _Vm;
 static STVm *Vm = &_Vm;
 
+static StObject EscapeBody;
+static StObject ApplyCode;
+static StObject HandlerReturnCode;
+static StObject HandlerErrorCode;
+static StObject ThreadStartCode;
+
+// Each invocation of vm() catches raised objects for the handlers it
+// installed. Scratch data of the compiler allocated after the invocation
+// started is released when the C stack is unwound.
+typedef struct STVmCatch
+{
+    struct STVmCatch *prev;
+    int level;
+    StRegionMark mark;
+    jmp_buf buf;
+} STVmCatch;
+
+static STVmCatch *Catch = NULL;
+
+// Limits
+//
+// eval-with-limits bounds the calls made, the time spent and the bytes
+// allocated by an evaluation. The vm has no backward jumps since every loop
+// goes through a call, so apply and call-known count Vm->ticks down and
+// reach a safepoint when it runs out. Without limits a safepoint just
+// refills the ticks. An exceeded limit abandons the evaluation at once;
+// handlers installed by the evaluated code can not catch it, and the after
+// thunks of its pending dynamic-winds are skipped, since they would run
+// with the limits already spent. Parameters it bound are still restored.
+// The evaluated code can not spawn threads, which would run on without the
+// limits.
+
+#define SAFEPOINT_INTERVAL 1024
+
+typedef struct STVmLimits
+{
+    struct STVmLimits *prev;
+    int level;  // of the vm invocation calling eval-with-limits
+    bool has_fuel;
+    long start; // fuel given
+    long fuel;  // calls left as of the last refill
+    long slice; // ticks given at the last refill
+    bool has_deadline;
+    struct timespec deadline;
+    bool has_heap;
+    size_t heap_end; // GC_get_total_bytes() to stop at
+    const char *exceeded;
+    STVm saved;
+    STVmCatch *catch;
+    StRegionMark mark;
+    jmp_buf buf;
+} STVmLimits;
+
+static STVmLimits *Limits = NULL;
+
 void St_InitVm(void)
 {
     Vm->stack = St_MakeVector(10000);
@@ -36,10 +102,141 @@ void St_InitVm(void)
     Vm->x = Nil;
     Vm->c = Nil;
     Vm->fp = Vm->f = Vm->s = 0;
+    Vm->values = St_MakeVector(8);
+    Vm->nvalues = 0;
+    Vm->handler = -1;
+    Vm->raised = Nil;
+    Vm->winders = Nil;
+    Vm->ticks = SAFEPOINT_INTERVAL;
+
+    EscapeBody = ST_LIST3(St_Intern("refer-local"),
+                          St_Integer(0),
+                          ST_LIST2(St_Intern("unwind"),
+                                   ST_LIST2(St_Intern("return"), St_Integer(0))));
+    ApplyCode = ST_LIST1(St_Intern("apply"));
+    HandlerReturnCode = ST_LIST2(St_Intern("handler-return"), True);
+    HandlerErrorCode = ST_LIST2(St_Intern("handler-return"), False);
+}
+
+static void reserve_values(int n)
+{
+    int capa = St_VectorLength(Vm->values);
+
+    if (n > capa)
+    {
+        Vm->values = St_MakeVector(n > capa * 2 ? n : capa * 2);
+    }
+    Vm->nvalues = n;
+}
+
+StObject St_Values(StCallInfo *cinfo)
+{
+    if (cinfo->count == 1)
+    {
+        return St_Arg(cinfo, 0);
+    }
+
+    reserve_values(cinfo->count);
+    for (int i = 0; i < cinfo->count; i++) {
+        St_VectorSet(Vm->values, i, St_Arg(cinfo, i));
+    }
+    return MultipleValues;
+}
+
+StObject St_Values2(StObject v1, StObject v2)
+{
+    reserve_values(2);
+    St_VectorSet(Vm->values, 0, v1);
+    St_VectorSet(Vm->values, 1, v2);
+    return MultipleValues;
+}
+
+// the value seen by a continuation which takes just one: the first of
+// multiple values, or nil for none
+StObject St_SingleValue(StObject obj)
+{
+    if (obj != MultipleValues)
+    {
+        return obj;
+    }
+    return Vm->nvalues > 0 ? St_VectorRef(Vm->values, 0) : Nil;
+}
+
+static int values_count(StObject obj)
+{
+    return obj == MultipleValues ? Vm->nvalues : 1;
+}
+
+static StObject values_ref(StObject obj, int i)
+{
+    return obj == MultipleValues ? St_VectorRef(Vm->values, i) : obj;
+}
+
+// copies multiple values in the accumulator to keep them while other
+// procedures are called
+static StObject save_values(StObject a)
+{
+    if (a != MultipleValues)
+    {
+        return False;
+    }
+
+    StObject v = St_MakeVector(Vm->nvalues);
+    St_CopyVector(v, Vm->values, Vm->nvalues);
+    return v;
+}
+
+static void restore_values(StObject saved)
+{
+    if (ST_FALSEP(saved))
+    {
+        return;
+    }
+
+    int n = St_VectorLength(saved);
+    reserve_values(n);
+    St_CopyVector(Vm->values, saved, n);
+}
+
+// The stacks of the main thread and of spawned ones start small and grow
+// as needed up to STACK_LIMIT slots.
+#define STACK_LIMIT (1024 * 1024)
+
+static void reserve_stack(int s)
+{
+    size_t len = ST_VECTOR_LENGTH(Vm->stack);
+
+    if ((size_t)s <= len)
+    {
+        return;
+    }
+
+    if (s > STACK_LIMIT)
+    {
+        St_Error("stack overflow");
+    }
+
+    while (len < (size_t)s)
+    {
+        len *= 2;
+    }
+    if (len > STACK_LIMIT)
+    {
+        len = STACK_LIMIT;
+    }
+
+    StObject stack = St_MakeVector(len);
+    St_CopyVector(stack, Vm->stack, ST_VECTOR_LENGTH(Vm->stack));
+    Vm->stack = stack;
 }
 
 static int push(StObject x, int s)
 {
+    if ((size_t)s >= ST_VECTOR_LENGTH(Vm->stack))
+    {
+        reserve_stack(s + 1);
+    }
+
     St_VectorSet(Vm->stack, s, x);
     return s + 1;
 }
@@ -70,6 +267,47 @@ static StObject make_closure(StObject body, int arity, int n, int s)
     return c;
 }
 
+static StObject make_case_lambda(int n, int s)
+{
+    StObject c = St_Alloc2(TLAMBDA, sizeof(struct StLambdaRec));
+    StObject clauses = St_MakeVector(n);
+
+    ST_LAMBDA_BODY(c) = Nil;
+    ST_LAMBDA_FREE(c) = clauses;
+    ST_LAMBDA_ARITY(c) = ST_CASE_LAMBDA_ARITY;
+
+    for (int i = 0; i < n; i++) {
+        StObject clause = index(s, n - i - 1);
+        if (!ST_LAMBDAP(clause))
+        {
+            St_Error("case-lambda: procedure required");
+        }
+        St_VectorSet(clauses, i, clause);
+    }
+
+    return c;
+}
+
+// returns the first clause of a case-lambda accepting argc arguments or
+// False if there is none
+StObject St_CaseLambdaClause(StObject proc, int argc)
+{
+    StObject clauses = ST_LAMBDA_FREE(proc);
+    int n = St_VectorLength(clauses);
+
+    for (int i = 0; i < n; i++) {
+        StObject clause = St_VectorRef(clauses, i);
+        int arity = ST_LAMBDA_ARITY(clause);
+
+        if (arity == argc || (arity < 0 && -arity - 1 <= argc))
+        {
+            return clause;
+        }
+    }
+
+    return False;
+}
+
 static StObject index_closure(StObject c, int n)
 {
     return St_VectorRef(ST_LAMBDA_FREE(c), n);
@@ -90,59 +328,751 @@ static StObject save_stack(int s)
     return v;
 }
 
-static int restore_stack(StObject v)
+static int restore_stack(StObject v)
+{
+    int s = St_VectorLength(v);
+    reserve_stack(s);
+    St_CopyVector(Vm->stack, v, s);
+    return s;
+}
+
+static StObject make_continuation(int s)
+{
+    return make_closure(ST_LIST3(St_Intern("refer-local"),
+                                 St_Integer(0),
+                                 ST_LIST5(St_Intern("nuate"),
+                                          save_stack(s),
+                                          St_Integer(Vm->handler),
+                                          Vm->winders,
+                                          ST_LIST2(St_Intern("return"), St_Integer(0)))),
+                        1,
+                        0,
+                        s);
+}
+
+// An escape procedure keeps the stack pointer just above the frame of its
+// call/ec, whether the call/ec has not returned yet, the handler and the
+// winders at the call/ec and the level of the vm invocation running it.
+// The escape itself is stored under the frame. An escape called from an
+// inner vm invocation longjmps to its own with ESCAPE_JUMP, which runs
+// the unwind again there.
+#define ESCAPE_JUMP 3
+
+static StObject make_escape(int level)
+{
+    StObject e = make_closure(EscapeBody, 1, 0, 0);
+    StObject st = St_MakeVector(5);
+
+    St_VectorSet(st, 0, St_Integer(0));
+    St_VectorSet(st, 1, True);
+    St_VectorSet(st, 2, St_Integer(Vm->handler));
+    St_VectorSet(st, 3, Vm->winders);
+    St_VectorSet(st, 4, St_Integer(level));
+    ST_LAMBDA_FREE(e) = st;
+
+    return e;
+}
+
+static StObject make_box(StObject obj)
+{
+    StObject v = St_MakeVector(1);
+
+    St_VectorSet(v, 0, obj);
+
+    return v;
+}
+
+static StObject unbox(StObject v)
+{
+    return St_VectorRef(v, 0);
+}
+
+static void set_box(StObject box, StObject obj)
+{
+    St_VectorSet(box, 0, obj);
+}
+
+static int shift_args(int n, int m, int s)
+{
+    if (m > 0)
+    {
+        for (int i = n - 1; i >= 0; i--) {
+            index_set(s, i + m, index(s, i));
+        }
+    }
+    else
+    {
+        for (int i = 0; i < n; i++) {
+            index_set(s, i + m, index(s, i));
+        }
+    }
+    return s - m;
+}
+
+// pops n arguments and the frame under them
+static void return_from_frame(int n)
+{
+    int s2 = Vm->s - n;
+    Vm->x = index(s2, 0);
+    Vm->f = ST_INT_VALUE(index(s2, 1));
+    Vm->fp = ST_INT_VALUE(index(s2, 2));
+    Vm->c = index(s2, 3);
+    Vm->s = s2 - 4;
+}
+
+static int push_frame(StObject ret, int s)
+{
+    return push(ret, push(St_Integer(Vm->f), push(St_Integer(Vm->fp), push(Vm->c, s))));
+}
+
+// Winders
+//
+// Vm->winders lists the dynamic extents entered, innermost first. An entry
+// is (before . after) for dynamic-wind or (parameter . value) for
+// parameterize, whose value is swapped with the binding of the parameter
+// on every entry and exit. Continuations, escapes and guards keep the
+// winders of their extent and reroot to them when they transfer the
+// control: after thunks are called up to the common tail of the lists
+// and then before thunks down from it.
+
+static void call_thunk(StObject thunk)
+{
+    St_Apply(thunk, &(StCallInfo){ ST_VECTOR(Vm->stack), Vm->s, 0 });
+}
+
+static void swap_binding(StObject entry)
+{
+    StObject param = ST_CAR(entry);
+    StObject v = St_ParameterRef(param);
+
+    St_ParameterSet(param, ST_CDR(entry));
+    ST_CDR_SET(entry, v);
+}
+
+static void leave_winder(StObject winders, bool wind)
+{
+    StObject entry = ST_CAR(winders);
+
+    Vm->winders = ST_CDR(winders);
+
+    if (St_ParameterP(ST_CAR(entry)))
+    {
+        swap_binding(entry);
+    }
+    else if (wind)
+    {
+        call_thunk(ST_CDR(entry));
+    }
+}
+
+static void enter_winder(StObject winders, bool wind)
+{
+    StObject entry = ST_CAR(winders);
+
+    Vm->winders = ST_CDR(winders);
+
+    if (St_ParameterP(ST_CAR(entry)))
+    {
+        swap_binding(entry);
+    }
+    else if (wind)
+    {
+        call_thunk(ST_CAR(entry));
+    }
+
+    Vm->winders = winders;
+}
+
+// restores the bindings of parameters and calls the before and after
+// thunks unless wind is false
+static void move_winders(StObject to, bool wind)
+{
+    StObject from = Vm->winders;
+
+    if (from == to)
+    {
+        return;
+    }
+
+    StObject a = Vm->a;
+    StObject values = save_values(a);
+    StObject entered = Nil;
+    int n = St_Length(from);
+    int m = St_Length(to);
+
+    for (; n > m; n--, from = ST_CDR(from)) {
+        leave_winder(from, wind);
+    }
+
+    for (; m > n; m--, to = ST_CDR(to)) {
+        entered = St_Cons(to, entered);
+    }
+
+    for (; from != to; from = ST_CDR(from), to = ST_CDR(to)) {
+        leave_winder(from, wind);
+        entered = St_Cons(to, entered);
+    }
+
+    ST_FOREACH(p, entered) {
+        enter_winder(ST_CAR(p), wind);
+    }
+
+    Vm->a = a;
+    restore_values(values);
+}
+
+static void reroot(StObject to)
+{
+    move_winders(to, true);
+}
+
+// Handler records
+//
+// guard and with-exception-handler push a record of 5 words followed by
+// a frame returning to pop-handler:
+//
+//  frame
+//  level      of the vm invocation        index(h, 0)  <- h
+//  previous   handler record              index(h, 1)
+//  unwind?    #t for guard                index(h, 2)
+//  handler                                index(h, 3)
+//  winders    at the guard                index(h, 4)
+//
+// Nothing else is done unless an object is raised.
+
+void St_Raise(StObject obj, bool continuable)
+{
+    if (Catch == NULL || Vm->handler < 0)
+    {
+        St_ReportUncaught(obj);
+    }
+
+    Vm->raised = obj;
+    Vm->continuable = continuable;
+    longjmp(Catch->buf, 1);
+}
+
+// Transfers the control to the innermost handler. A guard discards the
+// stack above its frame and the C stack of the inner vm invocations; the
+// handler of with-exception-handler is called on top of the raise.
+static void dispatch_raise(void)
+{
+    int h = Vm->handler;
+    int level = ST_INT_VALUE(index(h, 0));
+    StObject proc = index(h, 3);
+    StObject raised = Vm->raised;
+
+    Vm->handler = ST_INT_VALUE(index(h, 1));
+
+    if (ST_TRUEP(index(h, 2)))
+    {
+        if (level < Catch->level)
+        {
+            STVmCatch *c = Catch;
+            while (c->level > level)
+            {
+                c = c->prev;
+            }
+            Vm->handler = h;
+            longjmp(c->buf, 1);
+        }
+
+        reroot(index(h, 4));
+        Vm->s = h + 4;
+    }
+    else
+    {
+        Vm->s = push(St_Integer(h), Vm->s);
+        Vm->s = push_frame(Vm->continuable ? HandlerReturnCode : HandlerErrorCode, Vm->s);
+    }
+
+    Vm->fp = Vm->s;
+    Vm->s = push(raised, Vm->s);
+    Vm->a = proc;
+    Vm->x = ApplyCode;
+}
+
+static void charge(void)
+{
+    if (Limits != NULL)
+    {
+        Limits->fuel -= Limits->slice - Vm->ticks;
+        Limits->slice = Vm->ticks;
+    }
+}
+
+static void refill(void)
+{
+    long n = SAFEPOINT_INTERVAL;
+
+    if (Limits != NULL)
+    {
+        if (Limits->has_fuel && Limits->fuel < n)
+        {
+            n = Limits->fuel < 0 ? 0 : Limits->fuel;
+        }
+        Limits->slice = n;
+    }
+
+    Vm->ticks = n;
+}
+
+static bool timespec_lep(struct timespec *a, struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec <= b->tv_nsec);
+}
+
+static void exceed(const char *limit)
+{
+    Limits->exceeded = limit;
+    longjmp(Limits->buf, 1);
+}
+
+static bool preempt(void);
+
+// returns true if switched to another thread
+static bool safepoint(void)
+{
+    if (Limits != NULL)
+    {
+        charge();
+
+        if (Limits->has_fuel && Limits->fuel < 0)
+        {
+            exceed("fuel");
+        }
+
+        if (Limits->has_deadline)
+        {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (timespec_lep(&Limits->deadline, &now))
+            {
+                exceed("timeout");
+            }
+        }
+
+        if (Limits->has_heap && GC_get_total_bytes() >= Limits->heap_end)
+        {
+            exceed("max-heap");
+        }
+    }
+
+    refill();
+
+    return preempt();
+}
+
+// charges the calls made under the innermost limits to the enclosing ones
+static void leave_limits(void)
+{
+    STVmLimits *l = Limits;
+
+    charge();
+    Limits = l->prev;
+
+    if (Limits != NULL && Limits->has_fuel)
+    {
+        Limits->fuel -= l->start - l->fuel;
+    }
+
+    refill();
+}
+
+// Threads
+//
+// Each thread has its own stack and keeps the registers while it is not
+// running. Threads are switched only in the outermost vm invocation, where
+// nothing of the running thread is left on the C stack:
+//
+//  - at safepoints, when other threads are runnable
+//  - by thread-join, which parks the thread until the joined one exits
+//  - by reads from ports which don't have the input they need, which park
+//    the thread until the fd is readable. Waiting threads are polled at
+//    safepoints as well as when nothing else can run.
+//
+// A parked thread longjmps out of the subr back to the vm loop before the
+// subr changes anything, and runs the apply of the subr again when it is
+// resumed. Bindings of parameters are swapped when threads are switched.
+//
+// The program exits when the main thread finishes.
+
+#define THREAD_STACK_SIZE 2048 // to start with
+#define THREAD_PARK 2
+
+enum { THREAD_RUNNABLE, THREAD_JOINING, THREAD_WAITING, THREAD_DONE };
+
+struct StThreadRec
+{
+    ST_EXTERNAL_OBJECT_HEADER;
+    struct StThreadRec *next; // in the run queue or the waiting list
+    int state;
+    STVm vm;
+    StObject result;
+    bool failed; // result is the raised object
+    StObject joiners;
+    int fd;
+    short events;
+};
+typedef struct StThreadRec *StThread;
+#define ST_THREAD(x) ((StThread)(x))
+
+static StThread Current;
+static StThread RunHead = NULL;
+static StThread RunTail = NULL;
+static StThread Waiting = NULL;
+static int Threads = 1;
+
+static void display_thread(StObject obj __attribute__((unused)), StObject port)
+{
+    St_WriteCString("#<thread>", port);
+}
+
+static bool equalp_thread(StObject lhs, StObject rhs)
+{
+    return lhs == rhs;
+}
+
+static StExternalTypeInfo ThreadTypeInfo = (StExternalTypeInfo) { "<thread>", display_thread, equalp_thread };
+
+static bool threadp(StObject obj)
+{
+    return ST_EXTERNALP(obj) && ST_EXTERNAL_TYPE_INFO(obj) == &ThreadTypeInfo;
+}
+
+static StThread make_thread(void)
+{
+    StThread t = St_Alloc2(TEXTERNAL, sizeof(struct StThreadRec));
+
+    t->type_info = &ThreadTypeInfo;
+    t->next = NULL;
+    t->state = THREAD_RUNNABLE;
+    t->result = Unbound;
+    t->failed = false;
+    t->joiners = Nil;
+    t->fd = -1;
+
+    return t;
+}
+
+static void enqueue(StThread t)
+{
+    t->state = THREAD_RUNNABLE;
+    t->next = NULL;
+
+    if (RunTail == NULL)
+    {
+        RunHead = t;
+    }
+    else
+    {
+        RunTail->next = t;
+    }
+    RunTail = t;
+}
+
+static StThread dequeue(void)
+{
+    StThread t = RunHead;
+
+    RunHead = t->next;
+    if (RunHead == NULL)
+    {
+        RunTail = NULL;
+    }
+
+    return t;
+}
+
+static bool switchablep(void)
+{
+    return Catch != NULL && Catch->level == 0;
+}
+
+// moves the waiting threads which can run to the run queue, blocking
+// until some can for a negative timeout
+static void wait_io(int timeout)
+{
+    int n = 0;
+    for (StThread t = Waiting; t != NULL; t = t->next) {
+        n++;
+    }
+
+    struct pollfd fds[n];
+    int i = 0;
+    for (StThread t = Waiting; t != NULL; t = t->next) {
+        fds[i].fd = t->fd;
+        fds[i].events = t->events;
+        fds[i].revents = 0;
+        i++;
+    }
+
+    int ready = poll(fds, n, timeout);
+    if (ready == -1)
+    {
+        if (errno == EINTR)
+        {
+            return;
+        }
+        St_Error("thread: poll error");
+    }
+
+    if (ready == 0)
+    {
+        return;
+    }
+
+    StThread *p = &Waiting;
+    i = 0;
+    while (*p != NULL)
+    {
+        StThread t = *p;
+        if (fds[i++].revents != 0)
+        {
+            *p = t->next;
+            enqueue(t);
+        }
+        else
+        {
+            p = &t->next;
+        }
+    }
+}
+
+// runs the next runnable thread; the registers of the current thread
+// must be saved already
+static void switch_thread(void)
+{
+    while (RunHead == NULL)
+    {
+        if (Waiting == NULL)
+        {
+            St_Error("thread: deadlock");
+        }
+        wait_io(-1);
+    }
+
+    StThread t = dequeue();
+
+    move_winders(t->vm.winders, false);
+    *Vm = t->vm;
+    Current = t;
+}
+
+static bool preempt(void)
+{
+    if (!switchablep())
+    {
+        return false;
+    }
+
+    // threads waiting for fds which are ready take turns with the
+    // runnable ones
+    if (Waiting != NULL)
+    {
+        wait_io(0);
+    }
+
+    if (RunHead == NULL)
+    {
+        return false;
+    }
+
+    Current->vm = *Vm;
+    enqueue(Current);
+    switch_thread();
+
+    return true;
+}
+
+// leaves the subr running in the current thread, which runs again from
+// the apply of the subr when the thread is resumed
+static void park(void) __attribute__((noreturn));
+
+static void park(void)
+{
+    Current->vm = *Vm;
+    longjmp(Catch->buf, THREAD_PARK);
+}
+
+static void exit_thread(void)
+{
+    Current->state = THREAD_DONE;
+    Current->result = Vm->a;
+    Current->vm.stack = Nil;
+    Threads--;
+
+    ST_FOREACH(p, Current->joiners) {
+        enqueue(ST_THREAD(ST_CAR(p)));
+    }
+    Current->joiners = Nil;
+
+    switch_thread();
+}
+
+// parks the current thread until fd is ready for events if other threads
+// may run meanwhile
+static void wait_fd(int fd, short events)
+{
+    if (Threads == 1 || !switchablep())
+    {
+        return;
+    }
+
+    struct pollfd p = { fd, events, 0 };
+    if (poll(&p, 1, 0) != 0)
+    {
+        return;
+    }
+
+    Current->state = THREAD_WAITING;
+    Current->fd = fd;
+    Current->events = events;
+    Current->next = Waiting;
+    Waiting = Current;
+    park();
+}
+
+void St_WaitReadable(int fd)
 {
-    int s = St_VectorLength(v);
-    St_CopyVector(Vm->stack, v, s);
-    return s;
+    wait_fd(fd, POLLIN);
 }
 
-static StObject make_continuation(int s)
+// whether a thread waiting for input lets other threads run meanwhile
+bool St_ThreadsWaitableP(void)
 {
-    return make_closure(ST_LIST3(St_Intern("refer-local"),
-                                 St_Integer(0),
-                                 ST_LIST3(St_Intern("nuate"),
-                                          save_stack(s),
-                                          ST_LIST2(St_Intern("return"), St_Integer(0)))),
-                        1,
-                        0,
-                        s);
+    return Threads > 1 && switchablep();
 }
 
-static StObject make_box(StObject obj)
+static StObject subr_spawn(StCallInfo *cinfo)
 {
-    StObject v = St_MakeVector(1);
+    ST_ARGS1("spawn", cinfo, thunk);
 
-    St_VectorSet(v, 0, obj);
+    if (!ST_PROCEDUREP(thunk))
+    {
+        St_Error("spawn: procedure required");
+    }
 
-    return v;
-}
+    // a thread would outlive the limits of the evaluation spawning it
+    if (Limits != NULL)
+    {
+        St_Error("spawn: can not spawn a thread in eval-with-limits");
+    }
 
-static StObject unbox(StObject v)
-{
-    return St_VectorRef(v, 0);
+    StThread t = make_thread();
+
+    t->vm = *Vm;
+    t->vm.stack = St_MakeVector(THREAD_STACK_SIZE);
+    t->vm.values = St_MakeVector(8);
+    t->vm.nvalues = 0;
+    St_VectorSet(t->vm.stack, 0, thunk);
+    t->vm.s = t->vm.f = t->vm.fp = 1;
+    t->vm.c = Nil;
+    t->vm.a = Nil;
+    t->vm.x = ThreadStartCode;
+    t->vm.handler = -1;
+    t->vm.ticks = SAFEPOINT_INTERVAL;
+
+    Threads++;
+    enqueue(t);
+
+    return (StObject)t;
 }
 
-static void set_box(StObject box, StObject obj)
+static StObject subr_yield(StCallInfo *cinfo)
 {
-    St_VectorSet(box, 0, obj);
+    ST_ARGS0("yield", cinfo);
+
+    // the next call reaches a safepoint
+    charge();
+    Vm->ticks = 0;
+    if (Limits != NULL)
+    {
+        Limits->slice = 0;
+    }
+
+    return Nil;
 }
 
-static int shift_args(int n, int m, int s)
+static StObject subr_thread_join(StCallInfo *cinfo)
 {
-    if (m > 0)
+    ST_ARGS1("thread-join", cinfo, thread);
+
+    if (!threadp(thread))
     {
-        for (int i = n - 1; i >= 0; i--) {
-            index_set(s, i + m, index(s, i));
-        }
+        St_Error("thread-join: thread required");
     }
-    else
+
+    StThread t = ST_THREAD(thread);
+
+    if (t->state == THREAD_DONE)
     {
-        for (int i = 0; i < n; i++) {
-            index_set(s, i + m, index(s, i));
+        if (t->failed)
+        {
+            St_Raise(t->result, false);
         }
+        return t->result;
     }
-    return s - m;
+
+    if (t == Current)
+    {
+        St_Error("thread-join: can not join the current thread");
+    }
+
+    if (!switchablep())
+    {
+        St_Error("thread-join: can not wait in a nested evaluation");
+    }
+
+    if (RunHead == NULL && Waiting == NULL)
+    {
+        St_Error("thread: deadlock");
+    }
+
+    Current->state = THREAD_JOINING;
+    t->joiners = St_Cons((StObject)Current, t->joiners);
+    park();
+}
+
+static StObject subr_threadp(StCallInfo *cinfo)
+{
+    ST_ARGS1("thread?", cinfo, obj);
+
+    return ST_BOOLEAN(threadp(obj));
+}
+
+// handler of the raises nobody in the thread caught
+static StObject subr_thread_fail(StCallInfo *cinfo)
+{
+    ST_ARGS1("thread-fail", cinfo, obj);
+
+    Current->failed = true;
+
+    return obj;
+}
+
+void St_InitThread(void)
+{
+    StObject m = GlobalModule;
+
+    Current = make_thread();
+
+    // (constant thread-fail
+    //   (push-handler #t (pop-handler (thread-exit))
+    //     (refer-local 0 (apply))))
+    //
+    // The thunk is at the bottom of the stack.
+    ThreadStartCode = ST_LIST3(St_Intern("constant"),
+                               St_MakeSubr("thread-fail", subr_thread_fail),
+                               ST_LIST4(St_Intern("push-handler"),
+                                        True,
+                                        ST_LIST2(St_Intern("pop-handler"), ST_LIST1(St_Intern("thread-exit"))),
+                                        ST_LIST3(St_Intern("refer-local"), St_Integer(0), ST_LIST1(St_Intern("apply")))));
+
+    St_AddSubr(m, "spawn", subr_spawn);
+    St_AddSubr(m, "yield", subr_yield);
+    St_AddSubr(m, "thread-join", subr_thread_join);
+    St_AddSubr(m, "thread?", subr_threadp);
 }
 
 static StObject vm(StObject m, StObject insn)
@@ -155,29 +1085,84 @@ static StObject vm(StObject m, StObject insn)
     StObject refer_module = St_Intern("refer-module");
     INSN(indirect);
     INSN(constant);
+    INSN(inlined);
     INSN(close);
+    StObject case_lambda = St_Intern("case-lambda");
     INSN(box);
     INSN(test);
+    StObject switch_table = St_Intern("switch-table");
+    StObject switch_hash  = St_Intern("switch-hash");
     StObject assign_local  = St_Intern("assign-local");
     StObject assign_free   = St_Intern("assign-free");
     StObject assign_module = St_Intern("assign-module");
     INSN(conti);
     INSN(nuate);
+    INSN(escape);
+    StObject escape_end = St_Intern("escape-end");
+    INSN(unwind);
     INSN(frame);
     INSN(argument);
     INSN(extend);
     INSN(shift);
     INSN(apply);
+    INSN(receive);
+    StObject values_apply = St_Intern("values-apply");
+    StObject call_known = St_Intern("call-known");
+    StObject push_handler = St_Intern("push-handler");
+    StObject pop_handler = St_Intern("pop-handler");
+    StObject handler_return = St_Intern("handler-return");
+    StObject wind_push = St_Intern("wind-push");
+    StObject wind_pop = St_Intern("wind-pop");
+    StObject wind_end = St_Intern("wind-end");
+    INSN(parameterize);
+    StObject parameterize_end = St_Intern("parameterize-end");
+    StObject thread_exit = St_Intern("thread-exit");
     INSN(macro);
     StObject rtn = St_Intern("return");
 #undef INSN
 
 #define CASE(insn) if (ST_CAR(Vm->x) == insn)
 
+    // Toplevel code binds let variables above the current stack.
     StObject xo = Vm->x;
+    int fo = Vm->f;
     Vm->x = insn;
+    Vm->f = Vm->s;
     Vm->m = m;
 
+    STVmCatch catch;
+    catch.prev = Catch;
+    catch.level = Catch == NULL ? 0 : Catch->level + 1;
+    catch.mark = St_RegionMark();
+    Catch = &catch;
+
+    int jumped = setjmp(catch.buf);
+
+    if (jumped == THREAD_PARK)
+    {
+        Catch = &catch;
+        switch_thread();
+    }
+    else if (jumped != 0)
+    {
+        Catch = &catch;
+        St_RegionRelease(catch.mark);
+
+        // raised or escaped out of eval-with-limits
+        while (Limits != NULL && Limits->level >= catch.level)
+        {
+            leave_limits();
+        }
+
+        Vm->m = m;
+
+        // an escape runs its unwind again at this level
+        if (jumped != ESCAPE_JUMP)
+        {
+            dispatch_raise();
+        }
+    }
+
     while (true) {
 
         if (ST_TRUEP(St_DebugVM))
@@ -199,6 +1184,8 @@ static StObject vm(StObject m, StObject insn)
 
         CASE(halt) {
             Vm->x = xo;
+            Vm->f = fo;
+            Catch = catch.prev;
             return Vm->a;
         }
 
@@ -242,6 +1229,12 @@ static StObject vm(StObject m, StObject insn)
             continue;
         }
 
+        CASE(inlined) {
+            ST_BIND1("inlined", ST_CDR(Vm->x), x);
+            Vm->x = x;
+            continue;
+        }
+
         CASE(close) {
             ST_BIND4("close", ST_CDR(Vm->x), arity, n, body, x);
             Vm->a = make_closure(body, ST_INT_VALUE(arity), ST_INT_VALUE(n), Vm->s);
@@ -250,6 +1243,14 @@ static StObject vm(StObject m, StObject insn)
             continue;
         }
 
+        CASE(case_lambda) {
+            ST_BIND2("case-lambda", ST_CDR(Vm->x), n, x);
+            Vm->a = make_case_lambda(ST_INT_VALUE(n), Vm->s);
+            Vm->x = x;
+            Vm->s = Vm->s - ST_INT_VALUE(n);
+            continue;
+        }
+
         CASE(box) {
             ST_BIND2("box", ST_CDR(Vm->x), n, x);
             index_set(Vm->f, ST_INT_VALUE(n), make_box(index(Vm->f, ST_INT_VALUE(n))));
@@ -259,27 +1260,47 @@ static StObject vm(StObject m, StObject insn)
 
         CASE(test) {
             ST_BIND2("test", ST_CDR(Vm->x), thenc, elsec);
-            Vm->x = !ST_FALSEP(Vm->a) ? thenc : elsec;
+            Vm->x = !ST_FALSEP(St_SingleValue(Vm->a)) ? thenc : elsec;
+            continue;
+        }
+
+        CASE(switch_table) {
+            ST_BIND3("switch-table", ST_CDR(Vm->x), min, table, elsec);
+            Vm->x = elsec;
+            if (ST_INTP(Vm->a))
+            {
+                intptr_t i = ST_INT_VALUE(Vm->a) - ST_INT_VALUE(min);
+                if (0 <= i && i < (intptr_t)ST_VECTOR_LENGTH(table) && ST_TRUTHYP(ST_VECTOR_DATA(table)[i]))
+                {
+                    Vm->x = ST_VECTOR_DATA(table)[i];
+                }
+            }
+            continue;
+        }
+
+        CASE(switch_hash) {
+            ST_BIND2("switch-hash", ST_CDR(Vm->x), table, elsec);
+            Vm->x = St_HashtableRef(table, Vm->a, elsec);
             continue;
         }
 
         CASE(assign_local) {
             ST_BIND2("assign-local", ST_CDR(Vm->x), n, x);
-            set_box(index(Vm->f, ST_INT_VALUE(n)), Vm->a);
+            set_box(index(Vm->f, ST_INT_VALUE(n)), St_SingleValue(Vm->a));
             Vm->x = x;
             continue;
         }
 
         CASE(assign_free) {
             ST_BIND2("assign-free", ST_CDR(Vm->x), n, x);
-            set_box(index_closure(Vm->c, ST_INT_VALUE(n)), Vm->a);
+            set_box(index_closure(Vm->c, ST_INT_VALUE(n)), St_SingleValue(Vm->a));
             Vm->x = x;
             continue;
         }
 
         CASE(assign_module) {
             ST_BIND2("assign-module", ST_CDR(Vm->x), n, x);
-            St_ModuleSet(Vm->m, ST_INT_VALUE(n), Vm->a);
+            St_ModuleSet(Vm->m, ST_INT_VALUE(n), St_SingleValue(Vm->a));
             Vm->x = x;
             continue;
         }
@@ -292,24 +1313,184 @@ static StObject vm(StObject m, StObject insn)
         }
 
         CASE(nuate) {
-            ST_BIND2("nuate", ST_CDR(Vm->x), st, x);
+            ST_BIND4("nuate", ST_CDR(Vm->x), st, handler, winders, x);
+            reroot(winders);
             Vm->x = x;
             Vm->s = restore_stack(st);
+            Vm->handler = ST_INT_VALUE(handler);
+            continue;
+        }
+
+        CASE(escape) {
+            ST_BIND2("escape", ST_CDR(Vm->x), ret, x);
+            StObject e = make_escape(catch.level);
+            Vm->s = push(e, Vm->s);
+            Vm->s = push_frame(ret, Vm->s);
+            Vm->fp = Vm->s;
+            St_VectorSet(ST_LAMBDA_FREE(e), 0, St_Integer(Vm->s));
+            Vm->a = e;
+            Vm->x = x;
+            continue;
+        }
+
+        CASE(escape_end) {
+            ST_BIND1("escape-end", ST_CDR(Vm->x), x);
+            St_VectorSet(ST_LAMBDA_FREE(index(Vm->s, 0)), 1, False);
+            Vm->s--;
+            Vm->x = x;
+            continue;
+        }
+
+        CASE(unwind) {
+            ST_BIND1("unwind", ST_CDR(Vm->x), x);
+            StObject st = ST_LAMBDA_FREE(Vm->c);
+            int s = ST_INT_VALUE(St_VectorRef(st, 0));
+            int level = ST_INT_VALUE(St_VectorRef(st, 4));
+
+            if (ST_FALSEP(St_VectorRef(st, 1)) || level > catch.level || s > Vm->s || index(s, 4) != Vm->c)
+            {
+                St_Error("escape procedure called outside of its extent");
+            }
+
+            if (level < catch.level)
+            {
+                STVmCatch *c = Catch;
+                while (c->level > level)
+                {
+                    c = c->prev;
+                }
+                longjmp(c->buf, ESCAPE_JUMP);
+            }
+
+            reroot(St_VectorRef(st, 3));
+            Vm->x = x;
+            Vm->s = s;
+            Vm->handler = ST_INT_VALUE(St_VectorRef(st, 2));
             continue;
         }
 
         CASE(frame) {
             ST_BIND2("frame", ST_CDR(Vm->x), ret, x);
             Vm->x = x;
-            Vm->s = push(ret, push(St_Integer(Vm->f), push(St_Integer(Vm->fp), push(Vm->c, Vm->s))));
+            Vm->s = push_frame(ret, Vm->s);
+            Vm->fp = Vm->s;
+            continue;
+        }
+
+        CASE(push_handler) {
+            ST_BIND3("push-handler", ST_CDR(Vm->x), unwind, ret, x);
+            Vm->s = push(Vm->winders, Vm->s);
+            Vm->s = push(Vm->a, Vm->s);
+            Vm->s = push(unwind, Vm->s);
+            Vm->s = push(St_Integer(Vm->handler), Vm->s);
+            Vm->s = push(St_Integer(catch.level), Vm->s);
+            Vm->handler = Vm->s;
+            Vm->s = push_frame(ret, Vm->s);
             Vm->fp = Vm->s;
+            Vm->x = x;
+            continue;
+        }
+
+        CASE(pop_handler) {
+            ST_BIND1("pop-handler", ST_CDR(Vm->x), x);
+            Vm->handler = ST_INT_VALUE(index(Vm->s, 1));
+            Vm->s -= 5;
+            Vm->x = x;
+            continue;
+        }
+
+        CASE(handler_return) {
+            // returned from the handler of with-exception-handler
+            ST_BIND1("handler-return", ST_CDR(Vm->x), continuable);
+            int h = ST_INT_VALUE(index(Vm->s, 0));
+            Vm->s--;
+
+            if (ST_FALSEP(continuable))
+            {
+                Vm->handler = ST_INT_VALUE(index(h, 1));
+                St_Error("exception handler returned from non-continuable raise");
+            }
+
+            // returns from the call of raise-continuable
+            Vm->handler = h;
+            return_from_frame(Vm->s - Vm->fp);
+            continue;
+        }
+
+        CASE(wind_push) {
+            // before has returned
+            ST_BIND1("wind-push", ST_CDR(Vm->x), x);
+            Vm->winders = St_Cons(St_Cons(index(Vm->s, 2), index(Vm->s, 0)), Vm->winders);
+            Vm->x = x;
+            continue;
+        }
+
+        CASE(wind_pop) {
+            // thunk has returned; keeps its values while after is called
+            ST_BIND1("wind-pop", ST_CDR(Vm->x), x);
+            Vm->winders = ST_CDR(Vm->winders);
+            Vm->s = push(Vm->a, Vm->s);
+            Vm->s = push(save_values(Vm->a), Vm->s);
+            Vm->x = x;
+            continue;
+        }
+
+        CASE(wind_end) {
+            ST_BIND1("wind-end", ST_CDR(Vm->x), x);
+            Vm->a = index(Vm->s, 1);
+            restore_values(index(Vm->s, 0));
+            Vm->s -= 5;
+            Vm->x = x;
+            continue;
+        }
+
+        CASE(parameterize) {
+            ST_BIND2("parameterize", ST_CDR(Vm->x), n, x);
+            int k = ST_INT_VALUE(n);
+
+            // all values are converted before any of them is bound
+            for (int i = k; i > 0; i--) {
+                StObject param = index(Vm->s, i * 2);
+                if (!St_ParameterP(param))
+                {
+                    St_Error("parameterize: parameter required");
+                }
+                index_set(Vm->s, i * 2 - 1, St_ParameterConvert(param, index(Vm->s, i * 2 - 1)));
+            }
+
+            for (int i = k; i > 0; i--) {
+                StObject entry = St_Cons(index(Vm->s, i * 2), index(Vm->s, i * 2 - 1));
+                swap_binding(entry);
+                Vm->winders = St_Cons(entry, Vm->winders);
+            }
+
+            Vm->x = x;
+            continue;
+        }
+
+        CASE(parameterize_end) {
+            ST_BIND2("parameterize-end", ST_CDR(Vm->x), n, x);
+            int k = ST_INT_VALUE(n);
+
+            for (int i = 0; i < k; i++) {
+                swap_binding(ST_CAR(Vm->winders));
+                Vm->winders = ST_CDR(Vm->winders);
+            }
+
+            Vm->s -= k * 2 + 1;
+            Vm->x = x;
+            continue;
+        }
+
+        CASE(thread_exit) {
+            exit_thread();
             continue;
         }
 
         CASE(argument) {
             ST_BIND1("argument", ST_CDR(Vm->x), x);
             Vm->x = x;
-            Vm->s = push(Vm->a, Vm->s);
+            Vm->s = push(St_SingleValue(Vm->a), Vm->s);
             continue;
         }
 
@@ -331,6 +1512,11 @@ static StObject vm(StObject m, StObject insn)
         }
 
         CASE(apply) {
+            if (--Vm->ticks < 0 && safepoint())
+            {
+                continue;
+            }
+
             if (ST_SUBRP(Vm->a))
             {
                 // not supported higher order functions
@@ -338,16 +1524,22 @@ static StObject vm(StObject m, StObject insn)
 
                 Vm->a = ST_SUBR_BODY(Vm->a)(&(StCallInfo){ ST_VECTOR(Vm->stack), Vm->s, len });
 
-                // return
-                Vm->x = index(Vm->s, len + 0);
-                Vm->f = ST_INT_VALUE(index(Vm->s, len + 1));
-                Vm->fp = ST_INT_VALUE(index(Vm->s, len + 2));
-                Vm->c = index(Vm->s, len + 3);
-                Vm->s = Vm->s - len - 4;
+                return_from_frame(len);
             }
             else if (ST_LAMBDAP(Vm->a))
             {
                 int len = Vm->s - Vm->fp;
+
+                if (ST_CASE_LAMBDAP(Vm->a))
+                {
+                    StObject clause = St_CaseLambdaClause(Vm->a, len);
+                    if (ST_FALSEP(clause))
+                    {
+                        St_Error("case-lambda: no clause accepts %d arguments", len);
+                    }
+                    Vm->a = clause;
+                }
+
                 int arity = ST_LAMBDA_ARITY(Vm->a);
 
                 if (arity >= 0)
@@ -383,6 +1575,30 @@ static StObject vm(StObject m, StObject insn)
                 Vm->f = Vm->s;
                 Vm->c = Vm->a;
             }
+            else if (St_ParameterP(Vm->a))
+            {
+                int len = Vm->s - Vm->fp;
+                StObject param = Vm->a;
+
+                if (len > 1)
+                {
+                    St_Error("parameter: wrong number of arguments");
+                }
+
+                if (len == 1)
+                {
+                    // sets the innermost binding and returns the previous value
+                    StObject v = St_ParameterConvert(param, index(Vm->s, 0));
+                    Vm->a = St_ParameterRef(param);
+                    St_ParameterSet(param, v);
+                }
+                else
+                {
+                    Vm->a = St_ParameterRef(param);
+                }
+
+                return_from_frame(len);
+            }
             else
             {
                 St_Error("vm: procedure required");
@@ -390,6 +1606,65 @@ static StObject vm(StObject m, StObject insn)
             continue;
         }
 
+        CASE(receive) {
+            ST_BIND3("receive", ST_CDR(Vm->x), n, rest, x);
+            int required = ST_INT_VALUE(n);
+            int len = values_count(Vm->a);
+
+            if (len < required || (ST_FALSEP(rest) && len != required))
+            {
+                St_Error("wrong number of values: required %d but got %d", required, len);
+            }
+
+            for (int i = 0; i < required; i++) {
+                Vm->s = push(values_ref(Vm->a, i), Vm->s);
+            }
+
+            if (ST_TRUEP(rest))
+            {
+                StObject head = Nil;
+                StObject tail = Nil;
+
+                for (int i = required; i < len; i++) {
+                    ST_APPEND1(head, tail, values_ref(Vm->a, i));
+                }
+                Vm->s = push(head, Vm->s);
+            }
+
+            Vm->x = x;
+            continue;
+        }
+
+        CASE(values_apply) {
+            ST_BIND1("values-apply", ST_CDR(Vm->x), x);
+            StObject consumer = index(Vm->s, 0);
+            int len = values_count(Vm->a);
+
+            // the first argument is pushed last
+            Vm->s--;
+            for (int i = len - 1; i >= 0; i--) {
+                Vm->s = push(values_ref(Vm->a, i), Vm->s);
+            }
+
+            Vm->a = consumer;
+            Vm->x = x;
+            continue;
+        }
+
+        CASE(call_known) {
+            ST_BIND1("call-known", ST_CDR(Vm->x), proc);
+
+            if (--Vm->ticks < 0 && safepoint())
+            {
+                continue;
+            }
+
+            Vm->x = ST_LAMBDA_BODY(proc);
+            Vm->f = Vm->s;
+            Vm->c = proc;
+            continue;
+        }
+
         CASE(macro) {
             ST_BIND2("macro", ST_CDR(Vm->x), sym, x);
             Vm->a = make_macro(sym, Vm->a);
@@ -399,12 +1674,7 @@ static StObject vm(StObject m, StObject insn)
 
         CASE(rtn) {
             ST_BIND1("return", ST_CDR(Vm->x), n);
-            int s2 = Vm->s - ST_INT_VALUE(n);
-            Vm->x = index(s2, 0);
-            Vm->f = ST_INT_VALUE(index(s2, 1));
-            Vm->fp = ST_INT_VALUE(index(s2, 2));
-            Vm->c = index(s2, 3);
-            Vm->s = s2 - 4;
+            return_from_frame(ST_INT_VALUE(n));
             continue;
         }
     }
@@ -420,6 +1690,87 @@ StObject St__Eval_INSN(StObject module, StObject insn)
     return vm(module, insn);
 }
 
+
+StObject St_EvalWithLimits(StObject module, StObject expr, StEvalLimits *limits)
+{
+    STVmLimits l;
+
+    charge();
+
+    l.prev = Limits;
+    l.level = Catch == NULL ? -1 : Catch->level;
+    l.has_fuel = limits->fuel >= 0;
+    l.fuel = limits->fuel;
+    l.has_deadline = limits->timeout_ms >= 0;
+    l.has_heap = limits->max_heap >= 0;
+    l.heap_end = GC_get_total_bytes() + limits->max_heap;
+    l.exceeded = NULL;
+
+    if (l.has_deadline)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &l.deadline);
+        l.deadline.tv_sec += limits->timeout_ms / 1000;
+        l.deadline.tv_nsec += (limits->timeout_ms % 1000) * 1000000;
+        if (l.deadline.tv_nsec >= 1000000000)
+        {
+            l.deadline.tv_sec++;
+            l.deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    // limits never exceed the enclosing ones
+    STVmLimits *p = l.prev;
+    if (p != NULL)
+    {
+        if (p->has_fuel && (!l.has_fuel || p->fuel < l.fuel))
+        {
+            l.has_fuel = true;
+            l.fuel = p->fuel;
+        }
+        if (p->has_deadline && (!l.has_deadline || timespec_lep(&p->deadline, &l.deadline)))
+        {
+            l.has_deadline = true;
+            l.deadline = p->deadline;
+        }
+        if (p->has_heap && (!l.has_heap || p->heap_end < l.heap_end))
+        {
+            l.has_heap = true;
+            l.heap_end = p->heap_end;
+        }
+    }
+
+    l.start = l.fuel;
+    l.saved = *Vm;
+    l.catch = Catch;
+    l.mark = St_RegionMark();
+
+    if (setjmp(l.buf) != 0)
+    {
+        // the dynamic-wind after thunks of the evaluated code are not
+        // called; only the parameters are restored
+        Catch = l.catch;
+        St_RegionRelease(l.mark);
+        move_winders(l.saved.winders, false);
+        long ticks = Vm->ticks;
+        // the stack may have grown meanwhile
+        StObject stack = Vm->stack;
+        *Vm = l.saved;
+        Vm->stack = stack;
+        Vm->ticks = ticks;
+        leave_limits();
+        St_Error("eval-with-limits: %s exceeded", l.exceeded);
+    }
+
+    Limits = &l;
+    refill();
+
+    StObject value = St_Eval_VM(module, expr);
+
+    leave_limits();
+
+    return value;
+}
+
 #define I(x) St_Intern(x)
 
 StObject St_Apply(StObject proc, StCallInfo *cinfo)